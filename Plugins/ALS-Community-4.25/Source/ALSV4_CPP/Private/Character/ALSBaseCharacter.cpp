@@ -651,6 +651,32 @@ ECollisionChannel AALSBaseCharacter::GetThirdPersonTraceParams(FVector& TraceOri
 	return ECC_Visibility;
 }
 
+bool AALSBaseCharacter::SweepThirdPersonCamera(FHitResult& OutHit, const FVector& Start, const FVector& End,
+                                               ECollisionChannel TraceChannel, const FCollisionShape& Shape,
+                                               const FCollisionQueryParams& Params) const
+{
+	return GetWorld()->SweepSingleByChannel(OutHit, Start, End, FQuat::Identity, TraceChannel, Shape, Params);
+}
+
+FTransform AALSBaseCharacter::GetThirdPersonCameraTransform(const FVector& TraceOrigin,
+                                                            const FTransform& CameraTransform) const
+{
+	return CameraTransform;
+}
+
+bool AALSBaseCharacter::SweepMantleLedge(FHitResult& OutHit, FTransform& OutSweepToHit, const FVector& Start,
+                                         const FVector& End, FName ProfileName, const FCollisionShape& Shape,
+                                         const FCollisionQueryParams& Params)
+{
+	OutSweepToHit = FTransform::Identity;
+	return GetWorld()->SweepSingleByProfile(OutHit, Start, End, FQuat::Identity, ProfileName, Shape, Params);
+}
+
+void AALSBaseCharacter::MoveToMantleSpace(const FTransform& SweepToHit)
+{
+	SetActorTransform(GetActorTransform() * SweepToHit, false, nullptr, ETeleportType::TeleportPhysics);
+}
+
 FTransform AALSBaseCharacter::GetThirdPersonPivotTarget()
 {
 	return GetActorTransform();
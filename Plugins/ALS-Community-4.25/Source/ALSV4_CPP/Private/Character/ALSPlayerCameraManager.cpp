@@ -217,8 +217,8 @@ bool AALSPlayerCameraManager::CustomCameraBehavior(float DeltaTime, FVector& Loc
 
 	FHitResult HitResult;
 	const FCollisionShape SphereCollisionShape = FCollisionShape::MakeSphere(TraceRadius);
-	const bool bHit = World->SweepSingleByChannel(HitResult, TraceOrigin, TargetCameraLocation, FQuat::Identity,
-	                                              TraceChannel, SphereCollisionShape, Params);
+	const bool bHit = ControlledCharacter->SweepThirdPersonCamera(HitResult, TraceOrigin, TargetCameraLocation,
+	                                                              TraceChannel, SphereCollisionShape, Params);
 
 	if (ALSDebugComponent && ALSDebugComponent->GetShowTraces())
 	{
@@ -240,7 +240,8 @@ bool AALSPlayerCameraManager::CustomCameraBehavior(float DeltaTime, FVector& Loc
 	}
 
 	// Step 8: Lerp First Person Override and return target camera parameters.
-	FTransform TargetCameraTransform(TargetCameraRotation, TargetCameraLocation, FVector::OneVector);
+	const FTransform TargetCameraTransform = ControlledCharacter->GetThirdPersonCameraTransform(
+		TraceOrigin, FTransform(TargetCameraRotation, TargetCameraLocation, FVector::OneVector));
 	FTransform FPTargetCameraTransform(TargetCameraRotation, FPTarget, FVector::OneVector);
 
 	const FTransform& MixedTransform = UKismetMathLibrary::TLerp(TargetCameraTransform, FPTargetCameraTransform,
@@ -178,11 +178,14 @@ bool UALSMantleComponent::MantleCheck(const FALSMantleTraceSettings& TraceSettin
 	FCollisionQueryParams Params;
 	Params.AddIgnoredActor(OwnerCharacter);
 
+	// The ledge may be found somewhere else than in front of the character (e.g. through a portal), the rest
+	// of the check runs in the space of the hit and the character is moved there before mantling
 	FHitResult HitResult;
+	FTransform SweepToHit = FTransform::Identity;
 	{
 		const FCollisionShape CapsuleCollisionShape = FCollisionShape::MakeCapsule(TraceSettings.ForwardTraceRadius, HalfHeight);
-		const bool bHit = World->SweepSingleByProfile(HitResult, TraceStart, TraceEnd, FQuat::Identity, MantleObjectDetectionProfile,
-	                                                  CapsuleCollisionShape, Params);
+		const bool bHit = OwnerCharacter->SweepMantleLedge(HitResult, SweepToHit, TraceStart, TraceEnd,
+		                                                   MantleObjectDetectionProfile, CapsuleCollisionShape, Params);
 
 		if (ALSDebugComponent && ALSDebugComponent->GetShowTraces())
 		{
@@ -220,7 +223,7 @@ bool UALSMantleComponent::MantleCheck(const FALSMantleTraceSettings& TraceSettin
 
 	// Step 2: Trace downward from the first trace's Impact Point and determine if the hit location is walkable.
 	FVector DownwardTraceEnd = InitialTraceImpactPoint;
-	DownwardTraceEnd.Z = CapsuleBaseLocation.Z;
+	DownwardTraceEnd.Z = SweepToHit.TransformPosition(CapsuleBaseLocation).Z;
 	DownwardTraceEnd += InitialTraceNormal * -15.0f;
 	FVector DownwardTraceStart = DownwardTraceEnd;
 	DownwardTraceStart.Z += TraceSettings.MaxLedgeHeight + TraceSettings.DownwardTraceRadius + 1.0f;
@@ -275,7 +278,7 @@ bool UALSMantleComponent::MantleCheck(const FALSMantleTraceSettings& TraceSettin
 		CapsuleLocationFBase,
 		FVector::OneVector);
 
-	const float MantleHeight = (CapsuleLocationFBase - OwnerCharacter->GetActorLocation()).Z;
+	const float MantleHeight = (CapsuleLocationFBase - SweepToHit.TransformPosition(OwnerCharacter->GetActorLocation())).Z;
 
 	// Step 4: Determine the Mantle Type by checking the movement mode and Mantle Height.
 	EALSMantleType MantleType;
@@ -289,6 +292,11 @@ bool UALSMantleComponent::MantleCheck(const FALSMantleTraceSettings& TraceSettin
 	}
 
 	// Step 5: If everything checks out, start the Mantle
+	if (!SweepToHit.Equals(FTransform::Identity))
+	{
+		OwnerCharacter->MoveToMantleSpace(SweepToHit);
+	}
+
 	FALSComponentAndTransform MantleWS;
 	MantleWS.Component = HitComponent;
 	MantleWS.Transform = TargetTransform;
@@ -17,6 +17,8 @@
 class UALSDebugComponent;
 class UAnimMontage;
 class UALSPlayerCameraBehavior;
+struct FCollisionQueryParams;
+struct FCollisionShape;
 enum class EVisibilityBasedAnimTickOption : uint8;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FJumpPressedSignature);
@@ -289,6 +291,26 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "ALS|Camera System")
 	void SetCameraBehavior(UALSPlayerCameraBehavior* CamBeh) { CameraBehavior = CamBeh; }
 
+	/** Third person camera collision sweep. Override to change what stops the camera, OutHit is expected in the space of Start */
+	virtual bool SweepThirdPersonCamera(FHitResult& OutHit, const FVector& Start, const FVector& End,
+	                                    ECollisionChannel TraceChannel, const FCollisionShape& Shape,
+	                                    const FCollisionQueryParams& Params) const;
+
+	/** Third person camera pose after collision. Override to place the camera where the trace from TraceOrigin ended up, in its own space */
+	virtual FTransform GetThirdPersonCameraTransform(const FVector& TraceOrigin, const FTransform& CameraTransform) const;
+
+	/** Mantle System */
+
+	/**
+	 * Forward ledge sweep of the mantle check. Override to let the mantle reach past something the plain sweep
+	 * stops at. OutHit stays in world space, OutSweepToHit maps the character's space to the space of the hit.
+	 */
+	virtual bool SweepMantleLedge(FHitResult& OutHit, FTransform& OutSweepToHit, const FVector& Start, const FVector& End,
+	                              FName ProfileName, const FCollisionShape& Shape, const FCollisionQueryParams& Params);
+
+	/** Moves the character into the space of a ledge found by SweepMantleLedge, right before the mantle starts */
+	virtual void MoveToMantleSpace(const FTransform& SweepToHit);
+
 	/** Essential Information Getters/Setters */
 
 	UFUNCTION(BlueprintGetter, Category = "ALS|Essential Information")
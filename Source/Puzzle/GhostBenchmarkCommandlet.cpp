@@ -0,0 +1,371 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GhostBenchmarkCommandlet.h"
+
+#include "AIController.h"
+#include "EngineUtils.h"
+#include "GhostPlaybackSubsystem.h"
+#include "GhostRecording.h"
+#include "GhostReplayer.h"
+#include "Components/BoxComponent.h"
+#include "Dom/JsonObject.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "UObject/Package.h"
+#include <atomic>
+
+namespace
+{
+	/**
+	 * Counts allocator calls while installed as GMalloc, everything is forwarded to the real allocator.
+	 * Memory allocated before Install() is freed through Inner as usual, so swapping back is safe.
+	 */
+	class FGhostBenchmarkMalloc final : public FMalloc
+	{
+	public:
+		explicit FGhostBenchmarkMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+		uint64 GetAllocs() const { return Allocs.load(std::memory_order_relaxed); }
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override { Allocs.fetch_add(1, std::memory_order_relaxed); return Inner->Malloc(Count, Alignment); }
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override { Allocs.fetch_add(1, std::memory_order_relaxed); return Inner->TryMalloc(Count, Alignment); }
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override { Allocs.fetch_add(1, std::memory_order_relaxed); return Inner->Realloc(Original, Count, Alignment); }
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override { Allocs.fetch_add(1, std::memory_order_relaxed); return Inner->TryRealloc(Original, Count, Alignment); }
+		virtual void Free(void* Original) override { Inner->Free(Original); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+		virtual void UpdateStats() override { Inner->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+
+		FMalloc* Inner;
+
+	private:
+		std::atomic<uint64> Allocs { 0 };
+	};
+
+	struct FGhostBenchmarkFrame
+	{
+		int32 Frame = 0;
+		int32 Cycle = 0;
+		double FrameMs = 0.0;
+		double CaptureMs = 0.0;
+		double PlaybackMs = 0.0;
+		uint64 Allocs = 0;
+		int32 Spawns = 0;
+		int32 ActiveGhosts = 0;
+		int64 RecordingBytes = 0;
+		uint64 UsedPhysical = 0;
+	};
+
+	double Percentile(TArray<double> Values, double Fraction)
+	{
+		if (Values.Num() == 0)
+		{
+			return 0.0;
+		}
+		Values.Sort();
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Fraction * Values.Num()) - 1, 0, Values.Num() - 1);
+		return Values[Index];
+	}
+
+	void AddTimingSummary(const TSharedRef<FJsonObject>& Summary, const TCHAR* Name, const TArray<double>& Values)
+	{
+		double Total = 0.0;
+		for (double Value : Values)
+		{
+			Total += Value;
+		}
+
+		TSharedRef<FJsonObject> Timing = MakeShared<FJsonObject>();
+		Timing->SetNumberField(TEXT("mean_ms"), Values.Num() > 0 ? Total / Values.Num() : 0.0);
+		Timing->SetNumberField(TEXT("p50_ms"), Percentile(Values, 0.5));
+		Timing->SetNumberField(TEXT("p95_ms"), Percentile(Values, 0.95));
+		Timing->SetNumberField(TEXT("max_ms"), Percentile(Values, 1.0));
+		Summary->SetObjectField(Name, Timing);
+	}
+
+	AActor* SpawnFloor(UWorld* World)
+	{
+		AActor* Floor = World->SpawnActor<AActor>();
+		UBoxComponent* Box = NewObject<UBoxComponent>(Floor, TEXT("Floor"));
+		Box->SetBoxExtent(FVector(10000.0f, 10000.0f, 50.0f));
+		Box->SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+		Floor->SetRootComponent(Box);
+		Box->RegisterComponent();
+		Floor->SetActorLocation(FVector(0.0f, 0.0f, -50.0f));
+		return Floor;
+	}
+}
+
+UGhostBenchmarkCommandlet::UGhostBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = true;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UGhostBenchmarkCommandlet::Main(const FString& Params)
+{
+	FString MapName;
+	FParse::Value(*Params, TEXT("Map="), MapName);
+
+	int32 Cycles = 10;
+	int32 ReplayCount = 3;
+	float CaptureTime = 5.0f;
+	float CaptureRate = 20.0f;
+	float FPS = 60.0f;
+	FParse::Value(*Params, TEXT("Cycles="), Cycles);
+	FParse::Value(*Params, TEXT("ReplayCount="), ReplayCount);
+	FParse::Value(*Params, TEXT("CaptureTime="), CaptureTime);
+	FParse::Value(*Params, TEXT("CaptureRate="), CaptureRate);
+	FParse::Value(*Params, TEXT("FPS="), FPS);
+	Cycles = FMath::Max(Cycles, 2);
+	FPS = FMath::Max(FPS, 1.0f);
+
+	FString CharacterClassPath;
+	FParse::Value(*Params, TEXT("Character="), CharacterClassPath);
+	UClass* CharacterClass = ACharacter::StaticClass();
+	if (!CharacterClassPath.IsEmpty())
+	{
+		CharacterClass = LoadClass<ACharacter>(nullptr, *CharacterClassPath);
+		if (!CharacterClass)
+		{
+			UE_LOG(LogGhost, Error, TEXT("Could not load character class %s"), *CharacterClassPath);
+			return 1;
+		}
+	}
+
+	FString OutDir = FPaths::ProjectSavedDir() / TEXT("GhostBenchmark") / FDateTime::Now().ToString();
+	FParse::Value(*Params, TEXT("Out="), OutDir);
+
+	// Mundo de jogo sem viewport; com -Map carrega o mapa, senão um mundo vazio
+	UWorld* World = nullptr;
+	if (!MapName.IsEmpty())
+	{
+		UPackage* Package = LoadPackage(nullptr, *MapName, LOAD_None);
+		World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+		if (!World)
+		{
+			UE_LOG(LogGhost, Error, TEXT("Could not load map %s"), *MapName);
+			return 1;
+		}
+		World->AddToRoot();
+		World->WorldType = EWorldType::Game;
+		World->InitWorld();
+	}
+	else
+	{
+		World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("GhostBenchmark"));
+		World->AddToRoot();
+	}
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	const FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+	World->BeginPlay();
+
+	AGhostReplayer* Replayer = nullptr;
+	for (TActorIterator<AGhostReplayer> It(World); It; ++It)
+	{
+		Replayer = *It;
+		break;
+	}
+	if (!Replayer)
+	{
+		if (MapName.IsEmpty())
+		{
+			SpawnFloor(World);
+		}
+		Replayer = World->SpawnActor<AGhostReplayer>(FVector(0.0f, 0.0f, 400.0f), FRotator::ZeroRotator);
+		Replayer->Detection->SetBoxExtent(FVector(1500.0f, 1500.0f, 400.0f));
+	}
+	Replayer->DefaultReplayCount = ReplayCount;
+	Replayer->captureTime = CaptureTime;
+	Replayer->CaptureRate = CaptureRate;
+	if (FParse::Param(*Params, TEXT("NoKeyframeReduction")))
+	{
+		Replayer->KeyframeReduction.PositionTolerance = 0.0f;
+		Replayer->KeyframeReduction.RotationTolerance = 0.0f;
+	}
+
+	UGhostPlaybackSubsystem* Playback = World->GetSubsystem<UGhostPlaybackSubsystem>();
+
+	int32 Spawns = 0;
+	const FDelegateHandle SpawnHandle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateLambda([&Spawns](AActor*)
+	{
+		Spawns++;
+	}));
+
+	const FVector Start = Replayer->Detection->GetComponentLocation() - FVector(0.0f, 0.0f, Replayer->Detection->GetScaledBoxExtent().Z - 100.0f);
+	ACharacter* Character = World->SpawnActor<ACharacter>(CharacterClass, Start, FRotator::ZeroRotator);
+	if (!Character)
+	{
+		UE_LOG(LogGhost, Error, TEXT("Could not spawn the benchmark character"));
+		return 1;
+	}
+	// AIController só para o CMC consumir AddMovementInput e Jump
+	Character->AIControllerClass = AAIController::StaticClass();
+	Character->SpawnDefaultController();
+
+	FGhostBenchmarkMalloc* CountingMalloc = nullptr;
+	if (!FParse::Param(*Params, TEXT("NoAllocCount")))
+	{
+		CountingMalloc = new FGhostBenchmarkMalloc(GMalloc);
+		GMalloc = CountingMalloc;
+	}
+
+	const float DeltaTime = 1.0f / FPS;
+	const int32 FramesPerCycle = FMath::CeilToInt(CaptureTime * FPS);
+	const int32 NumFrames = Cycles * FramesPerCycle;
+
+	TArray<FGhostBenchmarkFrame> Frames;
+	Frames.Reserve(NumFrames);
+
+	// Recordings voltam a zero a cada ciclo, então guarda o pior caso visto
+	FGhostKeyframeStats KeyframeStats;
+
+	for (int32 Frame = 0; Frame < NumFrames; Frame++)
+	{
+		// Caminho fixo: círculo com um pulo a cada dois segundos, igual em toda execução
+		const float Time = (Frame % FramesPerCycle) * DeltaTime;
+		Character->AddMovementInput(FVector(FMath::Cos(Time * 1.5f), FMath::Sin(Time * 1.5f), 0.0f));
+		if (Frame % FMath::Max(FMath::RoundToInt(2.0f * FPS), 1) == 0)
+		{
+			Character->Jump();
+		}
+		else
+		{
+			Character->StopJumping();
+		}
+
+		const int32 SpawnsBefore = Spawns;
+		const uint64 AllocsBefore = CountingMalloc ? CountingMalloc->GetAllocs() : 0;
+
+		GFrameCounter++;
+		const double FrameStart = FPlatformTime::Seconds();
+		World->Tick(LEVELTICK_All, DeltaTime);
+		const double FrameSeconds = FPlatformTime::Seconds() - FrameStart;
+
+		FGhostBenchmarkFrame& Sample = Frames.AddDefaulted_GetRef();
+		Sample.Frame = Frame;
+		Sample.Cycle = Frame / FramesPerCycle;
+		Sample.FrameMs = FrameSeconds * 1000.0;
+		if (Playback && Playback->GetLastTimings().Frame == GFrameCounter)
+		{
+			Sample.CaptureMs = Playback->GetLastTimings().CaptureSeconds * 1000.0;
+			Sample.PlaybackMs = Playback->GetLastTimings().PlaybackSeconds * 1000.0;
+		}
+		Sample.Allocs = CountingMalloc ? CountingMalloc->GetAllocs() - AllocsBefore : 0;
+		Sample.Spawns = Spawns - SpawnsBefore;
+		Sample.ActiveGhosts = Playback ? Playback->GetNumActiveGhosts() : 0;
+		Sample.RecordingBytes = Replayer->GetRecordingMemoryBytes();
+
+		if ((Frame + 1) % FramesPerCycle == 0)
+		{
+			KeyframeStats.Accumulate(Replayer->GetKeyframeStats());
+		}
+		Sample.UsedPhysical = FPlatformMemory::GetStats().UsedPhysical;
+	}
+
+	if (CountingMalloc)
+	{
+		// Não deleta: memória alocada durante a contagem ainda pode ser liberada por ele
+		GMalloc = CountingMalloc->Inner;
+	}
+
+	World->RemoveOnActorSpawnedHandler(SpawnHandle);
+
+	// frames.csv
+	FString Csv = TEXT("frame,cycle,frame_ms,capture_ms,playback_ms,allocs,spawns,active_ghosts,recording_bytes,used_physical\n");
+	for (const FGhostBenchmarkFrame& Sample : Frames)
+	{
+		Csv += FString::Printf(TEXT("%d,%d,%.4f,%.4f,%.4f,%llu,%d,%d,%lld,%llu\n"),
+			Sample.Frame, Sample.Cycle, Sample.FrameMs, Sample.CaptureMs, Sample.PlaybackMs,
+			Sample.Allocs, Sample.Spawns, Sample.ActiveGhosts, Sample.RecordingBytes, Sample.UsedPhysical);
+	}
+
+	// summary.json, só o regime estável: o primeiro ciclo enche os pools
+	TArray<double> FrameMs;
+	TArray<double> CaptureMs;
+	TArray<double> PlaybackMs;
+	uint64 SteadyAllocs = 0;
+	int32 SteadySpawns = 0;
+	int32 PeakGhosts = 0;
+	int64 PeakRecordingBytes = 0;
+	uint64 PeakUsedPhysical = 0;
+	for (const FGhostBenchmarkFrame& Sample : Frames)
+	{
+		if (Sample.Cycle == 0)
+		{
+			continue;
+		}
+		FrameMs.Add(Sample.FrameMs);
+		CaptureMs.Add(Sample.CaptureMs);
+		PlaybackMs.Add(Sample.PlaybackMs);
+		SteadyAllocs += Sample.Allocs;
+		SteadySpawns += Sample.Spawns;
+		PeakGhosts = FMath::Max(PeakGhosts, Sample.ActiveGhosts);
+		PeakRecordingBytes = FMath::Max(PeakRecordingBytes, Sample.RecordingBytes);
+		PeakUsedPhysical = FMath::Max(PeakUsedPhysical, Sample.UsedPhysical);
+	}
+
+	TSharedRef<FJsonObject> Summary = MakeShared<FJsonObject>();
+	Summary->SetStringField(TEXT("map"), MapName.IsEmpty() ? TEXT("<generated>") : MapName);
+	Summary->SetStringField(TEXT("character"), CharacterClass->GetPathName());
+	Summary->SetNumberField(TEXT("cycles"), Cycles);
+	Summary->SetNumberField(TEXT("replay_count"), ReplayCount);
+	Summary->SetNumberField(TEXT("capture_time"), CaptureTime);
+	Summary->SetNumberField(TEXT("capture_rate"), CaptureRate);
+	Summary->SetNumberField(TEXT("fps"), FPS);
+	Summary->SetNumberField(TEXT("steady_frames"), FrameMs.Num());
+	AddTimingSummary(Summary, TEXT("frame"), FrameMs);
+	AddTimingSummary(Summary, TEXT("capture"), CaptureMs);
+	AddTimingSummary(Summary, TEXT("playback"), PlaybackMs);
+	Summary->SetNumberField(TEXT("allocs_per_frame"), FrameMs.Num() > 0 ? (double)SteadyAllocs / FrameMs.Num() : 0.0);
+	Summary->SetBoolField(TEXT("allocs_counted"), CountingMalloc != nullptr);
+	Summary->SetNumberField(TEXT("steady_spawns"), SteadySpawns);
+	Summary->SetNumberField(TEXT("peak_active_ghosts"), PeakGhosts);
+	Summary->SetNumberField(TEXT("peak_recording_bytes"), (double)PeakRecordingBytes);
+	Summary->SetNumberField(TEXT("peak_used_physical"), (double)PeakUsedPhysical);
+	Summary->SetNumberField(TEXT("keyframe_compression_ratio"), KeyframeStats.CompressionRatio);
+	Summary->SetNumberField(TEXT("keyframe_max_position_error"), KeyframeStats.MaxPositionError);
+	Summary->SetNumberField(TEXT("keyframe_max_rotation_error"), KeyframeStats.MaxRotationError);
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Summary, Writer);
+
+	const bool bSaved = FFileHelper::SaveStringToFile(Csv, *(OutDir / TEXT("frames.csv")))
+		&& FFileHelper::SaveStringToFile(Json, *(OutDir / TEXT("summary.json")));
+
+	UE_LOG(LogGhost, Display, TEXT("Ghost benchmark: %d frames, capture p95 %.3f ms, playback p95 %.3f ms, %.1f allocs/frame, %d steady spawns"),
+		FrameMs.Num(), Percentile(CaptureMs, 0.95), Percentile(PlaybackMs, 0.95),
+		FrameMs.Num() > 0 ? (double)SteadyAllocs / FrameMs.Num() : 0.0, SteadySpawns);
+	UE_LOG(LogGhost, Display, TEXT("Results written to %s"), *OutDir);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+
+	return bSaved ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "GhostBenchmarkCommandlet.generated.h"
+
+/**
+ * Headless, fixed time step benchmark of the ghost system.
+ *
+ *   UnrealEditor-Cmd Puzzle.uproject -run=GhostBenchmark -nullrhi
+ *       [-Map=/Game/...] [-Cycles=10] [-ReplayCount=3] [-CaptureTime=5] [-CaptureRate=20]
+ *       [-FPS=60] [-Character=/Game/...BP_C] [-Out=<dir>] [-NoAllocCount] [-NoKeyframeReduction]
+ *
+ * Without -Map a floor and an AGhostReplayer are spawned in an empty world. A character driven
+ * by a scripted path walks inside the replayer for Cycles capture windows. Every frame logs ghost
+ * capture/playback time, allocations, actor spawns and recording memory to frames.csv, and the
+ * steady state summary (first cycle excluded) goes to summary.json.
+ */
+UCLASS()
+class PUZZLE_API UGhostBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UGhostBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
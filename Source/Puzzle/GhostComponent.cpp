@@ -4,11 +4,10 @@
 #include "GhostComponent.h"
 
 #include "FollowerTimer.h"
+#include "GhostPlaybackSubsystem.h"
 #include "GhostReplayer.h"
+#include "GhostReplayFile.h"
 #include "Components/PoseableMeshComponent.h"
-#include "GameFramework/Character.h"
-#include "GameFramework/CharacterMovementComponent.h"
-#include "Kismet/GameplayStatics.h"
 
 
 // Sets default values for this component's properties
@@ -16,8 +15,8 @@ UGhostComponent::UGhostComponent()
 {
 	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
 	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
-	SetTickGroup(ETickingGroup::TG_LastDemotable);
+	// Capture and playback are batched by UGhostPlaybackSubsystem, the component never ticks
+	PrimaryComponentTick.bCanEverTick = false;
 
 	// ...
 }
@@ -28,6 +27,11 @@ void UGhostComponent::BeginPlay()
 {
 	Super::BeginPlay();
 	
+	HideGhost();
+}
+
+void UGhostComponent::HideGhost()
+{
 	AActor* Owner = GetOwner();
 	if (Owner)
 	{
@@ -61,10 +65,26 @@ void UGhostComponent::BeginPlay()
 }
 
 
-// Called every frame
-void UGhostComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+void UGhostComponent::StartCapture()
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	UWorld* World = GetWorld();
+	if (!World || PlaybackSlot != INDEX_NONE)
+	{
+		return;
+	}
+
+	if (UGhostPlaybackSubsystem* Playback = World->GetSubsystem<UGhostPlaybackSubsystem>())
+	{
+		bIsCapturing = true;
+		bIsPlaying = false;
+		ElapsedTime = 0.0f;
+		PlaybackSlot = Playback->RegisterGhost(this);
+	}
+}
+
+void UGhostComponent::UpdateTimerIcon(float InElapsedTime)
+{
+	ElapsedTime = InElapsedTime;
 
 	if(TargetIconActor && FollowTarget)
 	{
@@ -80,116 +100,51 @@ void UGhostComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActor
 			Timer->UpdatePercentage(percentage);
 		}
 	}
+}
 
-	if(ReplayCounter > ReplayCount)
-	{
-		GetOwner()->Destroy();
-		return;
-	}
-	if(bIsCapturing)
+void UGhostComponent::StopGhost()
+{
+	if (UWorld* World = GetWorld())
 	{
-		ElapsedTime += DeltaTime;
-		if(TickAccumulator >= captureInterval)
-		{
-			Capture();
-			TickAccumulator = 0.0f;
-		}
-		else
+		if (UGhostPlaybackSubsystem* Playback = World->GetSubsystem<UGhostPlaybackSubsystem>())
 		{
-			TickAccumulator += DeltaTime;
+			Playback->UnregisterGhost(PlaybackSlot);
 		}
-	} else if(bIsPlaying)
-	{		
-		iterateTransform();
 	}
-}
+	PlaybackSlot = INDEX_NONE;
+	bIsCapturing = false;
+	bIsPlaying = false;
 
+	ReleaseTimerIcon();
+	HideGhost();
+}
 
-void UGhostComponent::iterateTransform()
+void UGhostComponent::ReleaseTimerIcon()
 {
-
-	// Garante que temos um Owner que seja Character
-	ACharacter* GhostChar = Cast<ACharacter>(GetOwner());
-	if (!GhostChar)
-	{
-		bIsPlaying = false;
-		return;
-	}
-
-	// Se ainda temos "frames" pra reproduzir
-	if (CurrentTransformIndex < MovementSnapshots.Num())
+	if(TargetIconActor)
 	{
-		const FMovementSnapshot& Snapshot = MovementSnapshots[CurrentTransformIndex];
-
-		// 1) Força a posição e rotação
-		GhostChar->SetActorLocation(Snapshot.Location);
-		GhostChar->SetActorRotation(Snapshot.Rotation);
-
-		// 2) Define a velocity do MovementComponent
-		UCharacterMovementComponent* MoveComp = GhostChar->GetCharacterMovement();
-		if (MoveComp)
+		if (ParentGhostReplayer)
 		{
-			MoveComp->Velocity = Snapshot.Velocity;
-
-			// 3) Ajusta MovementMode
-			MoveComp->SetMovementMode(EMovementMode(Snapshot.MovementMode));
-
-			// Opcional: se quiser forçar "Falling" ou "Walking"
-			// se preferir, confie apenas em MovementMode
-			if (Snapshot.bIsFalling)
-			{
-				MoveComp->SetMovementMode(MOVE_Falling);
-			}
-			else
-			{
-				MoveComp->SetMovementMode(MOVE_Walking);
-			}
-
-			// Se quiser, força crouch/uncrouch de acordo com o snapshot
-			if (Snapshot.bIsCrouched)
-			{
-				GhostChar->Crouch();
-			}
-			else
-			{
-				GhostChar->UnCrouch();
-			}
+			ParentGhostReplayer->ReleaseTimerIcon(TargetIconActor);
 		}
-
-		// Avança pro próximo "frame"
-		CurrentTransformIndex++;
-	}
-	else
-	{
-		// Fim do replay
-		bIsPlaying = false;
+		else
+		{
+			TargetIconActor->Destroy();
+		}
+		TargetIconActor = nullptr;
 	}
 }
 
-
-void UGhostComponent::Capture()
+FGhostRecording* UGhostComponent::GetRecording() const
 {
-	if (ACharacter* Char = Cast<ACharacter>(FollowTarget))
-	{
-		// Cria um "frame" novo
-		FMovementSnapshot Snapshot;
-
-		Snapshot.Location     = Char->GetActorLocation();
-		Snapshot.Rotation     = Char->GetActorRotation();
-		Snapshot.Velocity     = Char->GetCharacterMovement()->Velocity;
-		Snapshot.bIsFalling   = Char->GetCharacterMovement()->IsFalling();
-		Snapshot.bIsCrouched  = Char->GetCharacterMovement()->IsCrouching(); 
-		Snapshot.MovementMode = Char->GetCharacterMovement()->MovementMode;
-		Snapshot.TimeStamp    = ElapsedTime; // só se precisar
-
-		// Armazena no array
-		MovementSnapshots.Add(Snapshot);
-	}
-	else
+	UWorld* World = GetWorld();
+	if (!World || PlaybackSlot == INDEX_NONE)
 	{
-		// Se não for Character, pode simplesmente capturar transforms...
-		TransformArray.Add(FollowTarget->GetActorTransform());
+		return nullptr;
 	}
+
+	UGhostPlaybackSubsystem* Playback = World->GetSubsystem<UGhostPlaybackSubsystem>();
+	return Playback ? &Playback->GetRecording(PlaybackSlot) : nullptr;
 }
 
 void UGhostComponent::SpawnTimer()
@@ -197,55 +152,100 @@ void UGhostComponent::SpawnTimer()
 	UWorld* World = GetWorld();
 	if (World && FollowTarget)
 	{
-		TargetIconActor = World->SpawnActor<AActor>(TargetIconActorClass, FollowTarget->GetActorLocation(), FollowTarget->GetActorRotation());
-
-		TArray<AActor*> AllActors;
-		UGameplayStatics::GetAllActorsOfClass(GetWorld(), AActor::StaticClass(), AllActors);
-
-		TArray<AActor*> ActorsWithGhostComponent;
-		for (AActor* Actor : AllActors)
+		if (ParentGhostReplayer)
 		{
-			if (Actor && Actor->FindComponentByClass<UGhostComponent>())
-			{
-				ActorsWithGhostComponent.Add(Actor);
-			}
+			TargetIconActor = ParentGhostReplayer->AcquireTimerIcon(FollowTarget->GetActorLocation(), FollowTarget->GetActorRotation());
 		}
-
-		int countSameParent = 0;
-		for (AActor* Actor : ActorsWithGhostComponent)
+		else
 		{
-			if (UGhostComponent *c = Actor->FindComponentByClass<UGhostComponent>())
-			{
-				if(c->ParentGhostReplayer == ParentGhostReplayer)
-					countSameParent++;
-			}
+			TargetIconActor = World->SpawnActor<AActor>(TargetIconActorClass, FollowTarget->GetActorLocation(), FollowTarget->GetActorRotation());
 		}
 
 		if(Cast<AFollowerTimer>(TargetIconActor) && ParentGhostReplayer)
 		{
 			AFollowerTimer* Timer = Cast<AFollowerTimer>(TargetIconActor);
-			int totalGhostsLeft = this->ParentGhostReplayer->DefaultReplayCount - countSameParent + 1;
+			int totalGhostsLeft = this->ParentGhostReplayer->DefaultReplayCount - ParentGhostReplayer->GetGhostCount(FollowTarget) + 1;
 			Timer->Text->SetText(FText::FromString(FString::Printf(TEXT("%d"), totalGhostsLeft)));
 			
 		}
 	}
 }
 
-void UGhostComponent::StartReplay()
+bool UGhostComponent::LoadRecording(TArrayView<const uint8> CompressedRecording)
+{
+	UWorld* World = GetWorld();
+	UGhostPlaybackSubsystem* Playback = World ? World->GetSubsystem<UGhostPlaybackSubsystem>() : nullptr;
+	if (!Playback)
+	{
+		return false;
+	}
+
+	if (PlaybackSlot != INDEX_NONE)
+	{
+		Playback->UnregisterGhost(PlaybackSlot);
+	}
+
+	bIsCapturing = false;
+	bIsPlaying = false;
+	PlaybackSlot = Playback->RegisterPlaybackGhost(this);
+	return FGhostReplayFile::DecompressRecording(CompressedRecording, Playback->GetRecording(PlaybackSlot));
+}
+
+void UGhostComponent::StartReplay(float StartOffset)
 {
 	bIsCapturing = false;
 	bIsPlaying = true;
-	CurrentTransformIndex = 0;
 	ReplayCounter++;
 
-	
-	
-	if(TargetIconActor)
+	if(ReplayCounter > ReplayCount)
 	{
-		
-		TargetIconActor->Destroy();
+		if (ParentGhostReplayer)
+		{
+			ParentGhostReplayer->ReleaseGhost(GetOwner());
+		}
+		else
+		{
+			GetOwner()->Destroy();
+		}
+		return;
 	}
 
+	if (UGhostPlaybackSubsystem* Playback = GetWorld()->GetSubsystem<UGhostPlaybackSubsystem>())
+	{
+		Playback->StartPlayback(PlaybackSlot, StartOffset);
+	}
+
+	ReleaseTimerIcon();
+	ShowGhost();
+}
+
+void UGhostComponent::StartStreamedReplay(const TSharedRef<FGhostReplayFile>& File, int32 StreamIndex, bool bLoop)
+{
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return;
+	}
+
+	UGhostPlaybackSubsystem* Playback = World->GetSubsystem<UGhostPlaybackSubsystem>();
+	if (!Playback)
+	{
+		return;
+	}
+
+	if (PlaybackSlot != INDEX_NONE)
+	{
+		Playback->UnregisterGhost(PlaybackSlot);
+	}
+
+	bIsCapturing = false;
+	bIsPlaying = true;
+	PlaybackSlot = Playback->RegisterStreamedGhost(this, File, StreamIndex, bLoop);
+	ShowGhost();
+}
+
+void UGhostComponent::ShowGhost()
+{
 	AActor* Owner = GetOwner();
 	if (Owner)
 	{
@@ -274,9 +274,15 @@ void UGhostComponent::StartReplay()
 void UGhostComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
-	if(TargetIconActor)
+
+	if (UWorld* World = GetWorld())
 	{
-		
-		TargetIconActor->Destroy();
+		if (UGhostPlaybackSubsystem* Playback = World->GetSubsystem<UGhostPlaybackSubsystem>())
+		{
+			Playback->UnregisterGhost(PlaybackSlot);
+		}
 	}
+	PlaybackSlot = INDEX_NONE;
+
+	ReleaseTimerIcon();
 }
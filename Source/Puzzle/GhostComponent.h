@@ -4,42 +4,12 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "GhostRecording.h"
 #include "GhostComponent.generated.h"
 
+class FGhostReplayFile;
 class UPoseableMeshComponent;
 
-USTRUCT(BlueprintType)
-struct FMovementSnapshot
-{
-	GENERATED_BODY()
-
-	UPROPERTY(BlueprintReadWrite)
-	FVector Location;
-
-	UPROPERTY(BlueprintReadWrite)
-	FRotator Rotation;
-
-	// Velocity que o MovementComponent estava usando naquele frame
-	UPROPERTY(BlueprintReadWrite)
-	FVector Velocity;
-
-	// Estados do MovementComponent
-	UPROPERTY(BlueprintReadWrite)
-	bool bIsFalling;
-
-	UPROPERTY(BlueprintReadWrite)
-	bool bIsCrouched;
-
-	// Se você quiser, pode armazenar MovementMode (MOVE_Walking, MOVE_Falling, etc.)
-	UPROPERTY(BlueprintReadWrite)
-	uint8 MovementMode;
-    
-	// Timestamp, se precisar de interpolação ou algo do tipo
-	UPROPERTY(BlueprintReadWrite)
-	float TimeStamp;
-};
-
-
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PUZZLE_API UGhostComponent : public UActorComponent
 {
@@ -54,10 +24,25 @@ protected:
 	virtual void BeginPlay() override;
 
 public:	
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
-	void iterateTransform();
-	void Capture();
+	// Hands the ghost to UGhostPlaybackSubsystem, which captures FollowTarget until StartReplay
+	void StartCapture();
+
+	// Moves the timer icon along with FollowTarget while capturing
+	void UpdateTimerIcon(float InElapsedTime);
+
+	FGhostRecording* GetRecording() const;
+
+	// Stops capture/playback and hides the owner so the replayer can put it back in its pool
+	void StopGhost();
+
+	// Hidden, no collision: the state of a ghost that is still capturing or sits in the pool
+	void HideGhost();
+
+	// Visible with the replay collision setup (CollisionResponses on top of the defaults)
+	void ShowGhost();
+
+	// Replays a stream of a loaded replay file instead of a capture of FollowTarget
+	void StartStreamedReplay(const TSharedRef<FGhostReplayFile>& File, int32 StreamIndex, bool bLoop);
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	int captureInterval = 0;
@@ -65,20 +50,26 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float captureTime = 5.0f;
 
+	// Frames per second kept in the recording, also sizes the ring buffer.
+	// Playback interpolates between frames so low rates still replay smoothly
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="1.0"))
+	float CaptureRate = 20.0f;
+
+	// Frames the replay can interpolate back within tolerance are not kept
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
-	int ReplayCount = 3;
+	FGhostKeyframeReduction KeyframeReduction;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	TArray<FTransform> TransformArray;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int ReplayCount = 3;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	AActor* FollowTarget;
 
+	// Slot in UGhostPlaybackSubsystem holding the recording and playback state
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	int CurrentTransformIndex = 0;
+	int PlaybackSlot = INDEX_NONE;
 
 	float ElapsedTime = 0.0f;
-	float TickAccumulator = 0.0f ;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	bool bIsCapturing = true;
@@ -89,10 +80,6 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	int ReplayCounter;
 
-	// GhostComponent.h
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	TArray<FMovementSnapshot> MovementSnapshots;
-
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TMap<TEnumAsByte<ECollisionChannel>, TEnumAsByte<ECollisionResponse>> CollisionResponses;
 
@@ -106,11 +93,14 @@ public:
 	class AGhostReplayer* ParentGhostReplayer;
 
 	void SpawnTimer();
-	
-	
+	void ReleaseTimerIcon();
+
 
+	// StartOffset skips into the recording, used by clients to catch up with the server
+	void StartReplay(float StartOffset = 0.0f);
 
-	void StartReplay();
+	// Claims a playback slot holding a recording compressed with FGhostReplayFile::CompressRecording
+	bool LoadRecording(TArrayView<const uint8> CompressedRecording);
 
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
@@ -0,0 +1,400 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GhostPlaybackSubsystem.h"
+
+#include "GhostComponent.h"
+#include "GhostProxy.h"
+#include "GhostReplayFile.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+
+DEFINE_STAT(STAT_GhostCapture);
+DEFINE_STAT(STAT_GhostPlayback);
+DEFINE_STAT(STAT_GhostActive);
+DEFINE_STAT(STAT_GhostStateChanges);
+DEFINE_STAT(STAT_GhostStreamDecode);
+DEFINE_STAT(STAT_GhostRestSkips);
+
+int32 UGhostPlaybackSubsystem::AllocateSlot()
+{
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		Slot = States.Num();
+		States.Add(ESlotState::Free);
+		Components.AddDefaulted();
+		Ghosts.AddDefaulted();
+		Targets.AddDefaulted();
+		Recordings.AddDefaulted();
+		Times.Add(0.0f);
+		CaptureIntervals.Add(0.0f);
+		Accumulators.Add(0.0f);
+		Cursors.Add(0);
+		AppliedFlags.Add(0);
+		Loops.Add(false);
+		Sources.AddDefaulted();
+		SourceStreams.Add(INDEX_NONE);
+		NextChunks.Add(0);
+		Resting.Add(false);
+		LastRestTimes.Add(0.0f);
+	}
+
+	Cursors[Slot] = 0;
+	AppliedFlags[Slot] = 0;
+	Loops[Slot] = false;
+	Sources[Slot].Reset();
+	SourceStreams[Slot] = INDEX_NONE;
+	NextChunks[Slot] = 0;
+	Resting[Slot] = false;
+	LastRestTimes[Slot] = 0.0f;
+
+	NumActive++;
+	return Slot;
+}
+
+int32 UGhostPlaybackSubsystem::RegisterGhost(UGhostComponent* Component)
+{
+	check(Component);
+
+	const int32 Slot = AllocateSlot();
+	States[Slot] = ESlotState::Capturing;
+	Components[Slot] = Component;
+	Ghosts[Slot] = Component->GetOwner();
+	Targets[Slot] = Component->FollowTarget;
+	Times[Slot] = 0.0f;
+	// Nunca captura mais rápido que CaptureRate, senão o ring buffer não comporta captureTime
+	CaptureIntervals[Slot] = FMath::Max((float)Component->captureInterval, 1.0f / Component->CaptureRate);
+	Accumulators[Slot] = 0.0f;
+	Recordings[Slot].Reserve(Component->captureTime, Component->CaptureRate, Component->KeyframeReduction);
+
+	return Slot;
+}
+
+int32 UGhostPlaybackSubsystem::RegisterStreamedGhost(UGhostComponent* Component, const TSharedRef<FGhostReplayFile>& File, int32 StreamIndex, bool bLoop)
+{
+	check(Component);
+	check(StreamIndex >= 0 && StreamIndex < File->NumStreams());
+
+	const FGhostReplayStream& Stream = File->GetStream(StreamIndex);
+
+	const int32 Slot = AllocateSlot();
+	States[Slot] = ESlotState::Playing;
+	Components[Slot] = Component;
+	Ghosts[Slot] = Component->GetOwner();
+	Targets[Slot].Reset();
+	Times[Slot] = Stream.StartTime;
+	Accumulators[Slot] = 0.0f;
+	Loops[Slot] = bLoop;
+	Sources[Slot] = File;
+	SourceStreams[Slot] = StreamIndex;
+
+	// O ring comporta o stream inteiro, depois da primeira volta o loop não decodifica mais nada
+	Recordings[Slot].ReserveFrames(Stream.NumFrames);
+	Recordings[Slot].SetOrigin(Stream.Origin);
+
+	return Slot;
+}
+
+void UGhostPlaybackSubsystem::UnregisterGhost(int32 Slot)
+{
+	if (!States.IsValidIndex(Slot) || States[Slot] == ESlotState::Free)
+	{
+		return;
+	}
+
+	States[Slot] = ESlotState::Free;
+	Components[Slot].Reset();
+	Ghosts[Slot].Reset();
+	Targets[Slot].Reset();
+	Recordings[Slot].Reset();
+	Sources[Slot].Reset();
+	FreeSlots.Add(Slot);
+	NumActive--;
+}
+
+int32 UGhostPlaybackSubsystem::RegisterPlaybackGhost(UGhostComponent* Component)
+{
+	check(Component);
+
+	const int32 Slot = AllocateSlot();
+	States[Slot] = ESlotState::Finished;
+	Components[Slot] = Component;
+	Ghosts[Slot] = Component->GetOwner();
+	Targets[Slot].Reset();
+	Times[Slot] = 0.0f;
+	Accumulators[Slot] = 0.0f;
+	Recordings[Slot].Reset();
+
+	return Slot;
+}
+
+void UGhostPlaybackSubsystem::StartPlayback(int32 Slot, float StartOffset)
+{
+	if (!States.IsValidIndex(Slot) || States[Slot] == ESlotState::Free)
+	{
+		return;
+	}
+
+	States[Slot] = Recordings[Slot].IsEmpty() ? ESlotState::Finished : ESlotState::Playing;
+	Times[Slot] = Recordings[Slot].GetStartTime() + FMath::Max(StartOffset, 0.0f);
+	Cursors[Slot] = 0;
+	// O ghost acabou de ser mostrado, estado visível e colisão precisam ser reaplicados
+	AppliedFlags[Slot] = 0;
+}
+
+bool UGhostPlaybackSubsystem::IsTickable() const
+{
+	return NumActive > 0;
+}
+
+TStatId UGhostPlaybackSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UGhostPlaybackSubsystem, STATGROUP_Tickables);
+}
+
+void UGhostPlaybackSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SET_DWORD_STAT(STAT_GhostActive, NumActive);
+
+	const double CaptureStart = FPlatformTime::Seconds();
+	TickCapture(DeltaTime);
+	const double PlaybackStart = FPlatformTime::Seconds();
+	TickPlayback(DeltaTime);
+
+	LastTimings.Frame = GFrameCounter;
+	LastTimings.CaptureSeconds = PlaybackStart - CaptureStart;
+	LastTimings.PlaybackSeconds = FPlatformTime::Seconds() - PlaybackStart;
+}
+
+bool UGhostPlaybackSubsystem::HasPendingChunks(int32 Slot) const
+{
+	const FGhostReplayFile* File = Sources[Slot].Get();
+	return File && NextChunks[Slot] < (int32)File->GetStream(SourceStreams[Slot]).NumChunks;
+}
+
+void UGhostPlaybackSubsystem::StreamChunks(int32 Slot)
+{
+	SCOPE_CYCLE_COUNTER(STAT_GhostStreamDecode);
+
+	const FGhostReplayFile& File = *Sources[Slot];
+	const FGhostReplayStream& Stream = File.GetStream(SourceStreams[Slot]);
+	FGhostRecording& Recording = Recordings[Slot];
+
+	while (HasPendingChunks(Slot) && (Recording.IsEmpty() || Recording.GetEndTime() < Times[Slot] + StreamLookahead))
+	{
+		if (!File.DecodeChunk(Stream.FirstChunk + NextChunks[Slot], Recording))
+		{
+			// Arquivo corrompido: toca o que já foi decodificado e para
+			NextChunks[Slot] = Stream.NumChunks;
+			Loops[Slot] = false;
+			break;
+		}
+		NextChunks[Slot]++;
+	}
+}
+
+FMovementSnapshot UGhostPlaybackSubsystem::BuildSnapshot(const AActor* Target, float Time, bool& bOutAsleep)
+{
+	// Cria um "frame" novo
+	FMovementSnapshot Snapshot;
+	Snapshot.Location  = Target->GetActorLocation();
+	Snapshot.Rotation  = Target->GetActorRotation();
+	Snapshot.TimeStamp = Time;
+	Snapshot.bIsHidden = Target->IsHidden();
+	Snapshot.bIsHeld   = Target->GetAttachParentActor() != nullptr;
+
+	if (const ACharacter* Char = Cast<ACharacter>(Target))
+	{
+		const UCharacterMovementComponent* MoveComp = Char->GetCharacterMovement();
+		Snapshot.Velocity     = MoveComp->Velocity;
+		Snapshot.bIsFalling   = MoveComp->IsFalling();
+		Snapshot.bIsCrouched  = MoveComp->IsCrouching();
+		Snapshot.MovementMode = MoveComp->MovementMode;
+		// Personagem nunca é pulado, o anim precisa de todos os frames
+		bOutAsleep = false;
+		return Snapshot;
+	}
+
+	const UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Target->GetRootComponent());
+	if (Primitive && Primitive->IsSimulatingPhysics())
+	{
+		Snapshot.Velocity = Primitive->GetPhysicsLinearVelocity();
+		Snapshot.AngularVelocity = Primitive->GetPhysicsAngularVelocityInDegrees();
+		bOutAsleep = !Primitive->IsAnyRigidBodyAwake();
+	}
+	else
+	{
+		// Sem física (ex.: pickup na mão): parado é não ter velocidade
+		Snapshot.Velocity = Target->GetVelocity();
+		bOutAsleep = Snapshot.Velocity.IsNearlyZero();
+	}
+	return Snapshot;
+}
+
+bool UGhostPlaybackSubsystem::IsSameState(const FMovementSnapshot& A, const FMovementSnapshot& B)
+{
+	// Tolerâncias do tamanho da quantização do FGhostRecording
+	return A.Location.Equals(B.Location, 1.0f / FGhostRecording::LocationScale)
+		&& A.Rotation.Equals(B.Rotation, 0.1f)
+		&& A.bIsHeld == B.bIsHeld
+		&& A.bIsHidden == B.bIsHidden;
+}
+
+void UGhostPlaybackSubsystem::TickCapture(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_GhostCapture);
+
+	for (int32 Slot = 0; Slot < States.Num(); Slot++)
+	{
+		if (States[Slot] != ESlotState::Capturing)
+		{
+			continue;
+		}
+
+		Times[Slot] += DeltaTime;
+		Accumulators[Slot] += DeltaTime;
+
+		UGhostComponent* Component = Components[Slot].Get();
+		AActor* Target = Targets[Slot].Get();
+		if (!Component || !Target)
+		{
+			continue;
+		}
+
+		if (Recordings[Slot].IsEmpty() || Accumulators[Slot] >= CaptureIntervals[Slot])
+		{
+			Accumulators[Slot] = 0.0f;
+
+			bool bAsleep = false;
+			const FMovementSnapshot Snapshot = BuildSnapshot(Target, Times[Slot], bAsleep);
+			FGhostRecording& Recording = Recordings[Slot];
+
+			if (Recording.IsEmpty())
+			{
+				Recording.Add(Snapshot);
+				Resting[Slot] = bAsleep;
+			}
+			else if (bAsleep && IsSameState(Recording.Get(Recording.Num() - 1), Snapshot))
+			{
+				// Parado: o último frame já representa esse intervalo todo
+				INC_DWORD_STAT(STAT_GhostRestSkips);
+				Resting[Slot] = true;
+				LastRestTimes[Slot] = Times[Slot];
+			}
+			else
+			{
+				if (Resting[Slot] && LastRestTimes[Slot] > Recording.GetEndTime())
+				{
+					// Acordou: repete a pose parada no último instante pulado, senão o replay
+					// interpolaria o movimento ao longo de todo o tempo parado
+					FMovementSnapshot Rest = Recording.Get(Recording.Num() - 1);
+					Rest.TimeStamp = LastRestTimes[Slot];
+					Recording.Add(Rest);
+				}
+				Recording.Add(Snapshot);
+				Resting[Slot] = bAsleep;
+			}
+		}
+
+		Component->UpdateTimerIcon(Times[Slot]);
+	}
+}
+
+void UGhostPlaybackSubsystem::TickPlayback(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_GhostPlayback);
+
+	for (int32 Slot = 0; Slot < States.Num(); Slot++)
+	{
+		if (States[Slot] != ESlotState::Playing)
+		{
+			continue;
+		}
+
+		// O replay segue o TimeStamp gravado, não o número de ticks
+		Times[Slot] += DeltaTime;
+
+		if (HasPendingChunks(Slot))
+		{
+			StreamChunks(Slot);
+		}
+
+		AActor* Ghost = Ghosts[Slot].Get();
+		const FGhostRecording& Recording = Recordings[Slot];
+		if (!Ghost || Recording.IsEmpty())
+		{
+			States[Slot] = ESlotState::Finished;
+			continue;
+		}
+
+		const FMovementSnapshot Snapshot = Recording.Sample(Times[Slot], Cursors[Slot]);
+
+		// Só mexe no estado de movimento quando o que foi gravado muda
+		const uint8 Flags = AppliedValid
+			| ((Snapshot.MovementMode & 0x07) << 2)
+			| (Snapshot.bIsFalling ? AppliedFalling : 0)
+			| (Snapshot.bIsCrouched ? AppliedCrouched : 0)
+			| (Snapshot.bIsHeld ? AppliedHeld : 0)
+			| (Snapshot.bIsHidden ? AppliedHidden : 0);
+		const bool bStateChanged = Flags != AppliedFlags[Slot];
+		if (bStateChanged)
+		{
+			INC_DWORD_STAT(STAT_GhostStateChanges);
+			AppliedFlags[Slot] = Flags;
+		}
+
+		if (AGhostProxy* Proxy = Cast<AGhostProxy>(Ghost))
+		{
+			Proxy->SetRecordedTransform(Snapshot.Location, Snapshot.Rotation);
+			if (Proxy->IsProp())
+			{
+				if (bStateChanged)
+				{
+					Proxy->SetPropState(Snapshot.bIsHeld, Snapshot.bIsHidden);
+				}
+			}
+			else
+			{
+				Proxy->SetVelocity(Snapshot.Velocity);
+				if (bStateChanged)
+				{
+					Proxy->SetMovementState(EMovementMode(Snapshot.MovementMode), Snapshot.bIsFalling, Snapshot.bIsCrouched);
+				}
+			}
+		}
+		else
+		{
+			// Clone de um ator sem mesh estático: só o transform
+			Ghost->SetActorLocationAndRotation(Snapshot.Location, Snapshot.Rotation);
+			if (bStateChanged)
+			{
+				Ghost->SetActorHiddenInGame(Snapshot.bIsHidden);
+			}
+		}
+
+		if (Times[Slot] >= Recording.GetEndTime() && !HasPendingChunks(Slot))
+		{
+			if (Loops[Slot])
+			{
+				Times[Slot] = Recording.GetStartTime();
+				Cursors[Slot] = 0;
+				AppliedFlags[Slot] = 0;
+				continue;
+			}
+
+			// Fim do replay
+			States[Slot] = ESlotState::Finished;
+			if (UGhostComponent* Component = Components[Slot].Get())
+			{
+				Component->bIsPlaying = false;
+			}
+		}
+	}
+}
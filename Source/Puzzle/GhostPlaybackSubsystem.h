@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GhostRecording.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "GhostPlaybackSubsystem.generated.h"
+
+class ACharacter;
+class FGhostReplayFile;
+class UGhostComponent;
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Ghost Capture"), STAT_GhostCapture, STATGROUP_Ghosts, PUZZLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Ghost Playback"), STAT_GhostPlayback, STATGROUP_Ghosts, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active Ghosts"), STAT_GhostActive, STATGROUP_Ghosts, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Ghost State Changes"), STAT_GhostStateChanges, STATGROUP_Ghosts, PUZZLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Ghost Stream Decode"), STAT_GhostStreamDecode, STATGROUP_Ghosts, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Ghost Frames Skipped At Rest"), STAT_GhostRestSkips, STATGROUP_Ghosts, PUZZLE_API);
+
+/** Wall time spent in the last subsystem tick, read by the ghost benchmark. */
+struct FGhostPlaybackTimings
+{
+	uint64 Frame = 0;
+	double CaptureSeconds = 0.0;
+	double PlaybackSeconds = 0.0;
+};
+
+/**
+ * Owns the recordings of every ghost in the world and advances all of them in one pass.
+ * Ghost state lives in parallel arrays indexed by slot; UGhostComponent only keeps its slot.
+ */
+UCLASS()
+class PUZZLE_API UGhostPlaybackSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Claims a slot for Component and starts capturing its FollowTarget. Characters are
+	 * captured every interval; any other actor is captured from its root body and frames
+	 * are skipped while it rests, so sleeping props cost nothing.
+	 */
+	int32 RegisterGhost(UGhostComponent* Component);
+	void UnregisterGhost(int32 Slot);
+
+	/**
+	 * Claims a slot that replays stream StreamIndex of File. Chunks are decoded
+	 * as playback gets close to them instead of loading the whole stream up front.
+	 */
+	int32 RegisterStreamedGhost(UGhostComponent* Component, const TSharedRef<FGhostReplayFile>& File, int32 StreamIndex, bool bLoop);
+
+	/** Claims an idle slot whose recording is filled by the caller, e.g. from the network. */
+	int32 RegisterPlaybackGhost(UGhostComponent* Component);
+
+	/** Rewinds the slot and starts replaying its recording, StartOffset seconds in. */
+	void StartPlayback(int32 Slot, float StartOffset = 0.0f);
+
+	FGhostRecording& GetRecording(int32 Slot) { return Recordings[Slot]; }
+	const FGhostRecording& GetRecording(int32 Slot) const { return Recordings[Slot]; }
+
+	int32 GetNumActiveGhosts() const { return NumActive; }
+
+	// Frame is GFrameCounter of the tick that measured them, stale when the subsystem did not tick
+	const FGhostPlaybackTimings& GetLastTimings() const { return LastTimings; }
+
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+private:
+	enum class ESlotState : uint8
+	{
+		Free,
+		Capturing,
+		Playing,
+		Finished
+	};
+
+	// Bits cached in AppliedFlags so the proxy state is only touched when they change.
+	// Bits 2-4 hold the movement mode
+	static constexpr uint8 AppliedFalling = 0x01;
+	static constexpr uint8 AppliedCrouched = 0x02;
+	static constexpr uint8 AppliedHeld = 0x20;
+	static constexpr uint8 AppliedHidden = 0x40;
+	static constexpr uint8 AppliedValid = 0x80;
+
+	// Seconds of frames decoded ahead of the playback time of a streamed slot
+	static constexpr float StreamLookahead = 1.0f;
+
+	int32 AllocateSlot();
+
+	/** Recorded state of Target; bOutAsleep is set when nothing about it is changing. */
+	static FMovementSnapshot BuildSnapshot(const AActor* Target, float Time, bool& bOutAsleep);
+	static bool IsSameState(const FMovementSnapshot& A, const FMovementSnapshot& B);
+
+	/** Decodes the chunks of a streamed slot needed up to Time + StreamLookahead. */
+	void StreamChunks(int32 Slot);
+	bool HasPendingChunks(int32 Slot) const;
+
+	void TickCapture(float DeltaTime);
+	void TickPlayback(float DeltaTime);
+
+	TArray<ESlotState> States;
+	TArray<TWeakObjectPtr<UGhostComponent>> Components;
+	TArray<TWeakObjectPtr<AActor>> Ghosts;
+	TArray<TWeakObjectPtr<AActor>> Targets;
+	TArray<FGhostRecording> Recordings;
+	TArray<float> Times;
+	TArray<float> CaptureIntervals;
+	TArray<float> Accumulators;
+	TArray<int32> Cursors;
+	TArray<uint8> AppliedFlags;
+	TArray<bool> Loops;
+	// Capture frames skipped while the target rests, LastRestTimes is the last one skipped
+	TArray<bool> Resting;
+	TArray<float> LastRestTimes;
+
+	// Only set for slots replaying a file
+	TArray<TSharedPtr<FGhostReplayFile>> Sources;
+	TArray<int32> SourceStreams;
+	TArray<int32> NextChunks;
+
+	TArray<int32> FreeSlots;
+	int32 NumActive = 0;
+
+	FGhostPlaybackTimings LastTimings;
+};
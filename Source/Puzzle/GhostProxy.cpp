@@ -0,0 +1,180 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GhostProxy.h"
+
+#include "GhostProxyAnimInstance.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+
+AGhostProxy::AGhostProxy()
+{
+	// Posição vem do UGhostPlaybackSubsystem, o proxy não precisa de tick
+	PrimaryActorTick.bCanEverTick = false;
+
+	Capsule = CreateDefaultSubobject<UCapsuleComponent>(TEXT("Capsule"));
+	Capsule->InitCapsuleSize(34.0f, StandingHalfHeight);
+	Capsule->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	Capsule->SetCanEverAffectNavigation(false);
+	RootComponent = Capsule;
+
+	Mesh = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("Mesh"));
+	Mesh->SetupAttachment(Capsule);
+	Mesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Mesh->SetGenerateOverlapEvents(false);
+	Mesh->SetCanEverAffectNavigation(false);
+	Mesh->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+	Mesh->bEnableUpdateRateOptimizations = true;
+
+	PropMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("PropMesh"));
+	PropMesh->SetupAttachment(Capsule);
+	PropMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	PropMesh->SetGenerateOverlapEvents(false);
+	PropMesh->SetCanEverAffectNavigation(false);
+	PropMesh->SetMobility(EComponentMobility::Movable);
+}
+
+bool AGhostProxy::InitializeFromCharacter(const ACharacter* Source)
+{
+	if (!Source)
+	{
+		return false;
+	}
+
+	bool bMeshChanged = false;
+
+	// Proxy que já foi de um prop volta a ser personagem
+	if (bIsProp)
+	{
+		PropMesh->SetStaticMesh(nullptr);
+		Mesh->SetVisibility(true);
+		Capsule->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+		bIsProp = false;
+		bMeshChanged = true;
+	}
+	PivotOffset = FVector::ZeroVector;
+
+	if (const UCapsuleComponent* SourceCapsule = Source->GetCapsuleComponent())
+	{
+		StandingHalfHeight = SourceCapsule->GetUnscaledCapsuleHalfHeight();
+		Capsule->SetCapsuleSize(SourceCapsule->GetUnscaledCapsuleRadius(), StandingHalfHeight);
+	}
+
+	if (const UCharacterMovementComponent* MoveComp = Source->GetCharacterMovement())
+	{
+		CrouchedHalfHeight = MoveComp->GetCrouchedHalfHeight();
+	}
+
+	if (const USkeletalMeshComponent* SourceMesh = Source->GetMesh())
+	{
+		if (Mesh->GetSkeletalMeshAsset() != SourceMesh->GetSkeletalMeshAsset())
+		{
+			Mesh->SetSkeletalMeshAsset(SourceMesh->GetSkeletalMeshAsset());
+			bMeshChanged = true;
+		}
+		BaseMeshLocation = SourceMesh->GetRelativeLocation();
+		Mesh->SetRelativeLocationAndRotation(BaseMeshLocation, SourceMesh->GetRelativeRotation());
+	}
+
+	// Sem GhostAnimClass usa o Anim Blueprint do personagem, melhor que a T-pose
+	const USkeletalMeshComponent* SourceMesh = Source->GetMesh();
+	UClass* AnimClass = GhostAnimClass ? GhostAnimClass.Get() : (SourceMesh ? SourceMesh->GetAnimClass() : nullptr);
+	if (AnimClass && Mesh->GetAnimClass() != AnimClass)
+	{
+		Mesh->SetAnimInstanceClass(AnimClass);
+	}
+	AnimInstance = Cast<UGhostProxyAnimInstance>(Mesh->GetAnimInstance());
+
+	// Proxy reaproveitado do pool pode ter ficado agachado
+	bCrouched = false;
+	Capsule->SetCapsuleHalfHeight(StandingHalfHeight);
+	return bMeshChanged;
+}
+
+bool AGhostProxy::InitializeFromActor(const AActor* Source, bool& bMeshFound)
+{
+	bMeshFound = false;
+	if (!Source)
+	{
+		return false;
+	}
+
+	// Root primeiro: no APickup é o mesh que o jogador vê
+	const UStaticMeshComponent* SourceMesh = Cast<UStaticMeshComponent>(Source->GetRootComponent());
+	if (!SourceMesh || !SourceMesh->GetStaticMesh())
+	{
+		SourceMesh = Source->FindComponentByClass<UStaticMeshComponent>();
+	}
+	if (!SourceMesh || !SourceMesh->GetStaticMesh())
+	{
+		return false;
+	}
+	bMeshFound = true;
+
+	bool bMeshChanged = !bIsProp || PropMesh->GetStaticMesh() != SourceMesh->GetStaticMesh();
+	bIsProp = true;
+	bCrouched = false;
+	AnimInstance = nullptr;
+
+	Mesh->SetSkeletalMeshAsset(nullptr);
+	Mesh->SetVisibility(false);
+
+	// Cápsula envolvendo o mesh, no espaço do ator; o pivot do prop nem sempre é o centro
+	const FBox LocalBounds = Source->CalculateComponentsBoundingBoxInLocalSpace(true);
+	const FVector Extent = LocalBounds.IsValid ? LocalBounds.GetExtent() : FVector(34.0f);
+	PivotOffset = LocalBounds.IsValid ? LocalBounds.GetCenter() : FVector::ZeroVector;
+	StandingHalfHeight = FMath::Max(Extent.Z, 1.0f);
+	Capsule->SetCapsuleSize(FMath::Max(Extent.X, Extent.Y), StandingHalfHeight);
+
+	FTransform MeshTransform = SourceMesh->GetComponentTransform().GetRelativeTransform(Source->GetActorTransform());
+	MeshTransform.AddToTranslation(-PivotOffset);
+	PropMesh->SetStaticMesh(SourceMesh->GetStaticMesh());
+	PropMesh->SetRelativeTransform(MeshTransform);
+	PropMesh->SetWorldScale3D(SourceMesh->GetComponentScale());
+	return bMeshChanged;
+}
+
+void AGhostProxy::SetRecordedTransform(const FVector& Location, const FRotator& Rotation)
+{
+	SetActorLocationAndRotation(Location + Rotation.RotateVector(PivotOffset), Rotation);
+}
+
+void AGhostProxy::SetPropState(bool bIsHeld, bool bIsHidden)
+{
+	SetActorHiddenInGame(bIsHidden);
+	// Na mão de alguém o prop não bloqueia nada, quem colide é o personagem
+	Capsule->SetCollisionEnabled(bIsHeld || bIsHidden ? ECollisionEnabled::NoCollision : ECollisionEnabled::QueryOnly);
+}
+
+void AGhostProxy::SetVelocity(const FVector& Velocity)
+{
+	if (AnimInstance)
+	{
+		AnimInstance->Velocity = Velocity;
+		AnimInstance->Speed = Velocity.Size2D();
+	}
+}
+
+void AGhostProxy::SetMovementState(EMovementMode MovementMode, bool bIsFalling, bool bIsCrouched)
+{
+	if (AnimInstance)
+	{
+		AnimInstance->MovementMode = MovementMode;
+		AnimInstance->bIsFalling = bIsFalling;
+		AnimInstance->bIsCrouched = bIsCrouched;
+	}
+
+	if (bCrouched == bIsCrouched)
+	{
+		return;
+	}
+	bCrouched = bIsCrouched;
+
+	// Mesmo ajuste que o ACharacter faz ao agachar: cápsula menor, mesh compensa a diferença
+	const float HalfHeight = bIsCrouched ? CrouchedHalfHeight : StandingHalfHeight;
+	Capsule->SetCapsuleHalfHeight(HalfHeight);
+	Mesh->SetRelativeLocation(BaseMeshLocation + FVector(0, 0, StandingHalfHeight - HalfHeight));
+}
@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "GhostProxy.generated.h"
+
+class ACharacter;
+class UCapsuleComponent;
+class USkeletalMeshComponent;
+class UStaticMeshComponent;
+class UGhostProxyAnimInstance;
+
+/**
+ * Cheap stand-in replaying a recorded actor: a capsule for collision and a skeletal mesh
+ * for characters, or a static mesh for props and pickups. No movement component, no input,
+ * no ALS state and no physics.
+ */
+UCLASS()
+class PUZZLE_API AGhostProxy : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AGhostProxy();
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	UCapsuleComponent* Capsule;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	USkeletalMeshComponent* Mesh;
+
+	// Only used when replaying a prop, empty for characters
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	UStaticMeshComponent* PropMesh;
+
+	// Anim Blueprint fed with the recorded movement state. Without one the proxy uses the recorded
+	// character's own Anim Blueprint, which gets no movement state but keeps the mesh out of its reference pose
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ghost")
+	TSubclassOf<UGhostProxyAnimInstance> GhostAnimClass;
+
+	// Copies mesh and capsule dimensions from the character being recorded.
+	// Returns true when the skeletal mesh changed, so material overrides need to be applied again
+	bool InitializeFromCharacter(const ACharacter* Source);
+
+	// Same for a prop: copies its static mesh and sizes the capsule to its bounds.
+	// Returns false in bMeshFound when Source has no static mesh to copy
+	bool InitializeFromActor(const AActor* Source, bool& bMeshFound);
+
+	bool IsProp() const { return bIsProp; }
+
+	// Recorded actor transform; props are offset so the capsule stays centered on their bounds
+	void SetRecordedTransform(const FVector& Location, const FRotator& Rotation);
+
+	// Velocity goes straight to the anim instance, mode and crouch only when they change
+	void SetVelocity(const FVector& Velocity);
+	void SetMovementState(EMovementMode MovementMode, bool bIsFalling, bool bIsCrouched);
+
+	// A held prop has no collision of its own, a hidden one is not drawn either
+	void SetPropState(bool bIsHeld, bool bIsHidden);
+
+private:
+	UPROPERTY(Transient)
+	UGhostProxyAnimInstance* AnimInstance;
+
+	float StandingHalfHeight = 88.0f;
+	float CrouchedHalfHeight = 40.0f;
+	FVector BaseMeshLocation = FVector::ZeroVector;
+	FVector PivotOffset = FVector::ZeroVector;
+	bool bCrouched = false;
+	bool bIsProp = false;
+};
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "Engine/EngineTypes.h"
+#include "GhostProxyAnimInstance.generated.h"
+
+/**
+ * Minimal anim instance for ghost proxies. AGhostProxy writes the recorded
+ * movement state here; an Anim Blueprint derived from it drives locomotion
+ * without the ALS character behind it.
+ */
+UCLASS()
+class PUZZLE_API UGhostProxyAnimInstance : public UAnimInstance
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	FVector Velocity = FVector::ZeroVector;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	float Speed = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	TEnumAsByte<EMovementMode> MovementMode = MOVE_Walking;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	bool bIsFalling = false;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+	bool bIsCrouched = false;
+};
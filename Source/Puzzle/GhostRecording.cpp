@@ -0,0 +1,334 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GhostRecording.h"
+
+DEFINE_STAT(STAT_GhostRecordingMemory);
+DEFINE_LOG_CATEGORY(LogGhost);
+
+namespace
+{
+	int16 QuantizeToShort(double Value)
+	{
+		return (int16)FMath::Clamp(FMath::RoundToInt(Value), (int32)MIN_int16, (int32)MAX_int16);
+	}
+
+	int32 QuantizeToInt(double Value, bool& bOutOverflow)
+	{
+		const double Rounded = FMath::RoundToDouble(Value);
+		if (Rounded < MIN_int32 || Rounded > MAX_int32)
+		{
+			bOutOverflow = true;
+			return Rounded < 0 ? MIN_int32 : MAX_int32;
+		}
+		return (int32)Rounded;
+	}
+}
+
+FGhostRecording::~FGhostRecording()
+{
+	DEC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, GetAllocatedSize());
+}
+
+void FGhostRecording::Reserve(float CaptureTime, float CaptureRate, const FGhostKeyframeReduction& InReduction)
+{
+	// Uma folga de dois frames para o primeiro e o último capture
+	const int32 NumFrames = FMath::CeilToInt(CaptureTime * CaptureRate) + 2;
+
+	// Com redução quase nunca chega na capacidade, começa com um oitavo e cresce se precisar
+	ReserveFrames(NumFrames, InReduction.IsEnabled() ? FMath::Max(NumFrames / 8, 16) : NumFrames);
+
+	Reduction = InReduction;
+	bReduce = Reduction.IsEnabled();
+	if (bReduce && Dropped.Max() < Reduction.MaxDroppedFrames)
+	{
+		DEC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, Dropped.GetAllocatedSize());
+		Dropped.Reserve(Reduction.MaxDroppedFrames);
+		INC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, Dropped.GetAllocatedSize());
+	}
+}
+
+void FGhostRecording::ReserveFrames(int32 NumFrames, int32 InitialFrames)
+{
+	const int32 NewCapacity = FMath::Max(NumFrames, 2);
+	const int32 NewAllocation = InitialFrames == INDEX_NONE ? NewCapacity : FMath::Clamp(InitialFrames, 2, NewCapacity);
+
+	Reset();
+	bReduce = false;
+	MaxFrames = NewCapacity;
+
+	// Slot reaproveitado mantém o que já cresceu, desde que caiba na capacidade nova
+	if (Frames.Num() >= NewAllocation && Frames.Num() <= NewCapacity)
+	{
+		return;
+	}
+
+	DEC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, Frames.GetAllocatedSize());
+	Frames.Empty(NewAllocation);
+	Frames.SetNumZeroed(NewAllocation);
+	INC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, Frames.GetAllocatedSize());
+}
+
+void FGhostRecording::Grow()
+{
+	// Só cresce antes do ring dar a volta, então Head ainda é 0 e os frames já estão em ordem
+	check(Head == 0);
+
+	DEC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, Frames.GetAllocatedSize());
+	Frames.SetNumZeroed(FMath::Min(Frames.Num() * 2, MaxFrames));
+	INC_MEMORY_STAT_BY(STAT_GhostRecordingMemory, Frames.GetAllocatedSize());
+}
+
+void FGhostRecording::Reset()
+{
+	Head = 0;
+	Count = 0;
+	Origin = FVector::ZeroVector;
+	bLoggedOverflow = false;
+	Stats = FGhostKeyframeStats();
+	Dropped.Reset();
+}
+
+void FGhostRecording::Add(const FMovementSnapshot& Snapshot)
+{
+	if (Frames.Num() == 0)
+	{
+		return;
+	}
+
+	if (Count == 0)
+	{
+		Origin = Snapshot.Location;
+	}
+
+	Stats.FramesCaptured++;
+
+	bool bOverflow = false;
+	const FGhostPackedFrame Frame = Pack(Snapshot, bOverflow);
+	if (bOverflow && !bLoggedOverflow)
+	{
+		bLoggedOverflow = true;
+		UE_LOG(LogGhost, Warning, TEXT("Ghost frame at %s is out of the packed range of origin %s, its location was clamped"),
+			*Snapshot.Location.ToString(), *Origin.ToString());
+	}
+
+	float PositionError = 0.0f;
+	float RotationError = 0.0f;
+	if (bReduce && Count >= 2 && CanDropLast(Snapshot, PositionError, RotationError))
+	{
+		// O último frame vira redundante: guarda para checar os próximos e escreve o novo por cima
+		Dropped.Add(Get(Count - 1));
+		Frames[(Head + Count - 1) % Frames.Num()] = Frame;
+
+		Stats.MaxPositionError = FMath::Max(Stats.MaxPositionError, PositionError);
+		Stats.MaxRotationError = FMath::Max(Stats.MaxRotationError, RotationError);
+	}
+	else
+	{
+		Dropped.Reset();
+		AddPacked(Frame);
+		Stats.FramesKept++;
+	}
+
+	Stats.CompressionRatio = Stats.FramesKept > 0 ? (float)Stats.FramesCaptured / Stats.FramesKept : 1.0f;
+}
+
+bool FGhostRecording::CanDropLast(const FMovementSnapshot& Next, float& OutPositionError, float& OutRotationError) const
+{
+	if (Dropped.Num() >= Reduction.MaxDroppedFrames)
+	{
+		return false;
+	}
+
+	const FMovementSnapshot Key = Get(Count - 2);
+	const FMovementSnapshot Last = Get(Count - 1);
+
+	// Estado discreto vem do frame anterior no Sample, então mudança de estado é sempre key
+	if (Last.MovementMode != Key.MovementMode || Last.bIsFalling != Key.bIsFalling || Last.bIsCrouched != Key.bIsCrouched
+		|| Last.bIsHeld != Key.bIsHeld || Last.bIsHidden != Key.bIsHidden)
+	{
+		return false;
+	}
+
+	const float Span = Next.TimeStamp - Key.TimeStamp;
+	if (Span <= UE_KINDA_SMALL_NUMBER)
+	{
+		return false;
+	}
+
+	const FQuat KeyRotation = Key.Rotation.Quaternion();
+	const FQuat NextRotation = Next.Rotation.Quaternion();
+
+	auto Check = [&](const FMovementSnapshot& Frame)
+	{
+		const float Alpha = FMath::Clamp((Frame.TimeStamp - Key.TimeStamp) / Span, 0.0f, 1.0f);
+
+		const float PositionError = FVector::Dist(FMath::Lerp(Key.Location, Next.Location, Alpha), Frame.Location);
+		const float RotationError = FMath::RadiansToDegrees(FQuat::Slerp(KeyRotation, NextRotation, Alpha).AngularDistance(Frame.Rotation.Quaternion()));
+		if (PositionError > Reduction.PositionTolerance || RotationError > Reduction.RotationTolerance)
+		{
+			return false;
+		}
+
+		OutPositionError = FMath::Max(OutPositionError, PositionError);
+		OutRotationError = FMath::Max(OutRotationError, RotationError);
+		return true;
+	};
+
+	for (const FMovementSnapshot& Frame : Dropped)
+	{
+		if (!Check(Frame))
+		{
+			return false;
+		}
+	}
+	return Check(Last);
+}
+
+void FGhostRecording::SetOrigin(const FVector& InOrigin)
+{
+	check(Count == 0);
+	Origin = InOrigin;
+}
+
+void FGhostRecording::AddPacked(const FGhostPackedFrame& Frame)
+{
+	if (Frames.Num() == 0)
+	{
+		return;
+	}
+
+	if (Count == Frames.Num() && Frames.Num() < MaxFrames)
+	{
+		Grow();
+	}
+
+	if (Count < Frames.Num())
+	{
+		Frames[(Head + Count) % Frames.Num()] = Frame;
+		Count++;
+	}
+	else
+	{
+		// Ring cheio: sobrescreve o frame mais antigo
+		Frames[Head] = Frame;
+		Head = (Head + 1) % Frames.Num();
+	}
+}
+
+FMovementSnapshot FGhostRecording::Get(int32 Index) const
+{
+	check(Index >= 0 && Index < Count);
+	return Unpack(GetPacked(Index));
+}
+
+FMovementSnapshot FGhostRecording::Sample(float Time, int32& Cursor) const
+{
+	check(Count > 0);
+
+	Cursor = FindFrame(Time, Cursor);
+	const FGhostPackedFrame& From = GetPacked(Cursor);
+	if (Cursor + 1 >= Count || Time <= From.TimeStamp)
+	{
+		return Unpack(From);
+	}
+
+	const FGhostPackedFrame& To = GetPacked(Cursor + 1);
+	const float Span = To.TimeStamp - From.TimeStamp;
+	const float Alpha = Span > UE_KINDA_SMALL_NUMBER ? FMath::Clamp((Time - From.TimeStamp) / Span, 0.0f, 1.0f) : 1.0f;
+
+	const FMovementSnapshot A = Unpack(From);
+	const FMovementSnapshot B = Unpack(To);
+
+	// Estados discretos (mode, crouch) vêm do frame anterior
+	FMovementSnapshot Result = A;
+	Result.TimeStamp = Time;
+	Result.Location = FMath::Lerp(A.Location, B.Location, Alpha);
+	Result.Velocity = FMath::Lerp(A.Velocity, B.Velocity, Alpha);
+	Result.Rotation = FQuat::Slerp(A.Rotation.Quaternion(), B.Rotation.Quaternion(), Alpha).Rotator();
+	Result.AngularVelocity = FMath::Lerp(A.AngularVelocity, B.AngularVelocity, Alpha);
+	return Result;
+}
+
+int32 FGhostRecording::FindFrame(float Time, int32 Cursor) const
+{
+	if (Cursor >= 0 && Cursor < Count && GetPacked(Cursor).TimeStamp <= Time)
+	{
+		// Caminho comum: o replay só anda pra frente, poucos frames por tick
+		while (Cursor + 1 < Count && GetPacked(Cursor + 1).TimeStamp <= Time)
+		{
+			Cursor++;
+		}
+		return Cursor;
+	}
+
+	// Upper bound: primeiro frame com TimeStamp > Time
+	int32 Low = 0;
+	int32 High = Count;
+	while (Low < High)
+	{
+		const int32 Mid = Low + (High - Low) / 2;
+		if (GetPacked(Mid).TimeStamp <= Time)
+		{
+			Low = Mid + 1;
+		}
+		else
+		{
+			High = Mid;
+		}
+	}
+	return FMath::Max(Low - 1, 0);
+}
+
+FGhostPackedFrame FGhostRecording::Pack(const FMovementSnapshot& Snapshot, bool& bOutOverflow) const
+{
+	FGhostPackedFrame Frame;
+	Frame.TimeStamp = Snapshot.TimeStamp;
+
+	const FVector Delta = (Snapshot.Location - Origin) * LocationScale;
+	Frame.Location[0] = QuantizeToInt(Delta.X, bOutOverflow);
+	Frame.Location[1] = QuantizeToInt(Delta.Y, bOutOverflow);
+	Frame.Location[2] = QuantizeToInt(Delta.Z, bOutOverflow);
+
+	Frame.Rotation[0] = FRotator::CompressAxisToShort(Snapshot.Rotation.Pitch);
+	Frame.Rotation[1] = FRotator::CompressAxisToShort(Snapshot.Rotation.Yaw);
+	Frame.Rotation[2] = FRotator::CompressAxisToShort(Snapshot.Rotation.Roll);
+
+	Frame.Velocity[0] = QuantizeToShort(Snapshot.Velocity.X);
+	Frame.Velocity[1] = QuantizeToShort(Snapshot.Velocity.Y);
+	Frame.Velocity[2] = QuantizeToShort(Snapshot.Velocity.Z);
+
+	Frame.AngularVelocity[0] = QuantizeToShort(Snapshot.AngularVelocity.X);
+	Frame.AngularVelocity[1] = QuantizeToShort(Snapshot.AngularVelocity.Y);
+	Frame.AngularVelocity[2] = QuantizeToShort(Snapshot.AngularVelocity.Z);
+
+	Frame.Flags = (Snapshot.MovementMode & 0x07)
+		| (Snapshot.bIsFalling ? 0x08 : 0)
+		| (Snapshot.bIsCrouched ? 0x10 : 0)
+		| (Snapshot.bIsHeld ? 0x20 : 0)
+		| (Snapshot.bIsHidden ? 0x40 : 0);
+
+	return Frame;
+}
+
+FMovementSnapshot FGhostRecording::Unpack(const FGhostPackedFrame& Frame) const
+{
+	FMovementSnapshot Snapshot;
+	Snapshot.TimeStamp = Frame.TimeStamp;
+
+	Snapshot.Location = Origin + FVector(Frame.Location[0], Frame.Location[1], Frame.Location[2]) / LocationScale;
+	Snapshot.Rotation = FRotator(
+		FRotator::DecompressAxisFromShort(Frame.Rotation[0]),
+		FRotator::DecompressAxisFromShort(Frame.Rotation[1]),
+		FRotator::DecompressAxisFromShort(Frame.Rotation[2]));
+	Snapshot.Velocity = FVector(Frame.Velocity[0], Frame.Velocity[1], Frame.Velocity[2]);
+	Snapshot.AngularVelocity = FVector(Frame.AngularVelocity[0], Frame.AngularVelocity[1], Frame.AngularVelocity[2]);
+
+	Snapshot.MovementMode = Frame.Flags & 0x07;
+	Snapshot.bIsFalling = (Frame.Flags & 0x08) != 0;
+	Snapshot.bIsCrouched = (Frame.Flags & 0x10) != 0;
+	Snapshot.bIsHeld = (Frame.Flags & 0x20) != 0;
+	Snapshot.bIsHidden = (Frame.Flags & 0x40) != 0;
+
+	return Snapshot;
+}
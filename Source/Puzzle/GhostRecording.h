@@ -0,0 +1,218 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GhostRecording.generated.h"
+
+DECLARE_STATS_GROUP(TEXT("Ghosts"), STATGROUP_Ghosts, STATCAT_Advanced);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Recording Memory"), STAT_GhostRecordingMemory, STATGROUP_Ghosts, PUZZLE_API);
+
+PUZZLE_API DECLARE_LOG_CATEGORY_EXTERN(LogGhost, Log, All);
+
+USTRUCT(BlueprintType)
+struct FMovementSnapshot
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	FVector Location = FVector::ZeroVector;
+
+	UPROPERTY(BlueprintReadWrite)
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	// Velocity que o MovementComponent estava usando naquele frame
+	UPROPERTY(BlueprintReadWrite)
+	FVector Velocity = FVector::ZeroVector;
+
+	// Estados do MovementComponent
+	UPROPERTY(BlueprintReadWrite)
+	bool bIsFalling = false;
+
+	UPROPERTY(BlueprintReadWrite)
+	bool bIsCrouched = false;
+
+	// Se você quiser, pode armazenar MovementMode (MOVE_Walking, MOVE_Falling, etc.)
+	UPROPERTY(BlueprintReadWrite)
+	uint8 MovementMode = 0;
+
+	// Timestamp, se precisar de interpolação ou algo do tipo
+	UPROPERTY(BlueprintReadWrite)
+	float TimeStamp = 0.0f;
+
+	// Só para corpos com física, em graus por segundo
+	UPROPERTY(BlueprintReadWrite)
+	FVector AngularVelocity = FVector::ZeroVector;
+
+	// Preso a outro ator, por exemplo um pickup na mão do personagem
+	UPROPERTY(BlueprintReadWrite)
+	bool bIsHeld = false;
+
+	UPROPERTY(BlueprintReadWrite)
+	bool bIsHidden = false;
+};
+
+/**
+ * Online keyframe reduction applied while capturing. A frame is dropped when its
+ * neighbours reconstruct it, and every frame dropped since the last key, within tolerance.
+ */
+USTRUCT(BlueprintType)
+struct FGhostKeyframeReduction
+{
+	GENERATED_BODY()
+
+	// Max distance between a dropped frame and its interpolated position.
+	// Both tolerances at 0 disable the reduction
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", Units="Centimeters"))
+	float PositionTolerance = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", Units="Degrees"))
+	float RotationTolerance = 1.0f;
+
+	// Forces a key after this many dropped frames, bounds the cost of checking a candidate
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="1"))
+	int32 MaxDroppedFrames = 40;
+
+	bool IsEnabled() const { return PositionTolerance > 0.0f || RotationTolerance > 0.0f; }
+};
+
+USTRUCT(BlueprintType)
+struct FGhostKeyframeStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 FramesCaptured = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 FramesKept = 0;
+
+	// FramesCaptured / FramesKept
+	UPROPERTY(BlueprintReadOnly)
+	float CompressionRatio = 1.0f;
+
+	// Worst reconstruction error of any dropped frame
+	UPROPERTY(BlueprintReadOnly)
+	float MaxPositionError = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float MaxRotationError = 0.0f;
+
+	void Accumulate(const FGhostKeyframeStats& Other)
+	{
+		FramesCaptured += Other.FramesCaptured;
+		FramesKept += Other.FramesKept;
+		CompressionRatio = FramesKept > 0 ? (float)FramesCaptured / FramesKept : 1.0f;
+		MaxPositionError = FMath::Max(MaxPositionError, Other.MaxPositionError);
+		MaxRotationError = FMath::Max(MaxRotationError, Other.MaxRotationError);
+	}
+};
+
+/**
+ * A single recorded frame, quantized against the origin of its recording.
+ * Location in half centimeters, rotation as compressed shorts, velocity in cm/s,
+ * angular velocity in degrees/s. Location is 32 bits: portals send the recorded actor
+ * far past the ±163 m an int16 would hold.
+ */
+struct FGhostPackedFrame
+{
+	float TimeStamp;
+	int32 Location[3];
+	uint16 Rotation[3];
+	int16 Velocity[3];
+	int16 AngularVelocity[3];
+	// bits 0-2: MovementMode, bit 3: falling, bit 4: crouched, bit 5: held, bit 6: hidden
+	uint8 Flags;
+};
+
+/**
+ * Bounded ring of packed frames for one ghost. With keyframe reduction the ring starts
+ * small and doubles up to the capacity given to Reserve(); the allocation survives Reset()
+ * so a pooled slot only grows during its first cycles.
+ */
+class PUZZLE_API FGhostRecording
+{
+public:
+	/** Units per centimeter used for the location deltas. */
+	static constexpr float LocationScale = 2.0f;
+
+	FGhostRecording() = default;
+	~FGhostRecording();
+
+	FGhostRecording(const FGhostRecording&) = delete;
+	FGhostRecording& operator=(const FGhostRecording&) = delete;
+
+	/** Room for CaptureTime seconds of frames captured at CaptureRate per second. */
+	void Reserve(float CaptureTime, float CaptureRate, const FGhostKeyframeReduction& InReduction = FGhostKeyframeReduction());
+
+	/** Capacity of NumFrames frames, InitialFrames of them allocated now. */
+	void ReserveFrames(int32 NumFrames, int32 InitialFrames = INDEX_NONE);
+
+	/** Drops every frame but keeps the allocation. */
+	void Reset();
+
+	/**
+	 * Appends a frame, overwriting the oldest one once the ring is full. With reduction
+	 * enabled the previous frame is replaced instead when it can be interpolated back.
+	 */
+	void Add(const FMovementSnapshot& Snapshot);
+
+	/** Decodes the frame at Index, 0 being the oldest frame still in the ring. */
+	FMovementSnapshot Get(int32 Index) const;
+
+	/**
+	 * Interpolated state at Time. Cursor caches the last frame used so sequential
+	 * playback only walks forward; any other jump falls back to a binary search.
+	 */
+	FMovementSnapshot Sample(float Time, int32& Cursor) const;
+
+	float GetStartTime() const { return Count > 0 ? GetPacked(0).TimeStamp : 0.0f; }
+	float GetEndTime() const { return Count > 0 ? GetPacked(Count - 1).TimeStamp : 0.0f; }
+
+	int32 Num() const { return Count; }
+	int32 Capacity() const { return MaxFrames; }
+	bool IsEmpty() const { return Count == 0; }
+
+	SIZE_T GetAllocatedSize() const { return Frames.GetAllocatedSize() + Dropped.GetAllocatedSize(); }
+
+	const FGhostKeyframeStats& GetKeyframeStats() const { return Stats; }
+
+	// Raw access for FGhostReplayFile, frames stay quantized against the origin
+	const FVector& GetOrigin() const { return Origin; }
+	const FGhostPackedFrame& GetPacked(int32 Index) const { return Frames[(Head + Index) % Frames.Num()]; }
+
+	/** Starts an empty recording whose packed frames are relative to InOrigin. */
+	void SetOrigin(const FVector& InOrigin);
+
+	/** Appends an already packed frame, same ring rules as Add(). */
+	void AddPacked(const FGhostPackedFrame& Frame);
+
+private:
+
+	/** Index of the last frame whose TimeStamp is <= Time, clamped to the ring. */
+	int32 FindFrame(float Time, int32 Cursor) const;
+
+	/** bOutOverflow is set when the location is too far from Origin for the packed range and got clamped. */
+	FGhostPackedFrame Pack(const FMovementSnapshot& Snapshot, bool& bOutOverflow) const;
+	FMovementSnapshot Unpack(const FGhostPackedFrame& Frame) const;
+
+	/** True when the last frame and everything in Dropped can be interpolated from the frame before it and Next. */
+	bool CanDropLast(const FMovementSnapshot& Next, float& OutPositionError, float& OutRotationError) const;
+
+	void Grow();
+
+	TArray<FGhostPackedFrame> Frames;
+	int32 MaxFrames = 0;
+
+	FGhostKeyframeReduction Reduction;
+	bool bReduce = false;
+	FGhostKeyframeStats Stats;
+	// Frames dropped since the last key, decoded
+	TArray<FMovementSnapshot> Dropped;
+
+	FVector Origin = FVector::ZeroVector;
+	// Overflow is logged once per recording
+	bool bLoggedOverflow = false;
+	int32 Head = 0;
+	int32 Count = 0;
+};
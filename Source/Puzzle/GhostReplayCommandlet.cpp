@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GhostReplayCommandlet.h"
+
+#include "GhostRecording.h"
+#include "GhostReplayFile.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+UGhostReplayCommandlet::UGhostReplayCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UGhostReplayCommandlet::Main(const FString& Params)
+{
+	FString Dir = FPaths::ProjectSavedDir() / TEXT("Ghosts");
+	FParse::Value(*Params, TEXT("Dir="), Dir);
+
+	int32 Passes = 1;
+	FParse::Value(*Params, TEXT("Passes="), Passes);
+	Passes = FMath::Max(Passes, 1);
+
+	TArray<FString> FileNames;
+	IFileManager::Get().FindFiles(FileNames, *(Dir / TEXT("*.ghost")), true, false);
+	FileNames.Sort();
+
+	if (FileNames.Num() == 0)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("No .ghost files in %s"), *Dir);
+		return 0;
+	}
+
+	int32 NumFailed = 0;
+	int64 TotalFileBytes = 0;
+	int64 TotalRawBytes = 0;
+	int64 TotalFrames = 0;
+	double TotalDecodeSeconds = 0.0;
+
+	FGhostRecording Scratch;
+
+	for (const FString& FileName : FileNames)
+	{
+		const FString Path = Dir / FileName;
+		TSharedPtr<FGhostReplayFile> File = FGhostReplayFile::Open(Path);
+		if (!File)
+		{
+			UE_LOG(LogGhost, Error, TEXT("FAIL %s: invalid header or tables"), *FileName);
+			NumFailed++;
+			continue;
+		}
+
+		bool bValid = true;
+		int64 FileFrames = 0;
+		double DecodeSeconds = 0.0;
+
+		for (int32 Pass = 0; Pass < Passes && bValid; Pass++)
+		{
+			for (int32 StreamIndex = 0; StreamIndex < File->NumStreams() && bValid; StreamIndex++)
+			{
+				const FGhostReplayStream& Stream = File->GetStream(StreamIndex);
+				Scratch.ReserveFrames(Stream.NumFrames);
+				Scratch.SetOrigin(Stream.Origin);
+
+				const double Start = FPlatformTime::Seconds();
+				for (uint32 Chunk = 0; Chunk < Stream.NumChunks && bValid; Chunk++)
+				{
+					bValid = File->DecodeChunk(Stream.FirstChunk + Chunk, Scratch);
+				}
+				DecodeSeconds += FPlatformTime::Seconds() - Start;
+
+				if (!bValid)
+				{
+					UE_LOG(LogGhost, Error, TEXT("FAIL %s: stream %d does not decode"), *FileName, StreamIndex);
+					break;
+				}
+
+				// Frames têm que estar em ordem para o Sample funcionar
+				for (int32 Frame = 1; Frame < Scratch.Num(); Frame++)
+				{
+					if (Scratch.GetPacked(Frame).TimeStamp < Scratch.GetPacked(Frame - 1).TimeStamp)
+					{
+						UE_LOG(LogGhost, Error, TEXT("FAIL %s: stream %d goes back in time at frame %d"), *FileName, StreamIndex, Frame);
+						bValid = false;
+						break;
+					}
+				}
+
+				if (bValid && (Scratch.GetStartTime() != Stream.StartTime || Scratch.GetEndTime() != Stream.EndTime))
+				{
+					UE_LOG(LogGhost, Error, TEXT("FAIL %s: stream %d time range does not match its table"), *FileName, StreamIndex);
+					bValid = false;
+				}
+
+				if (Pass == 0)
+				{
+					FileFrames += Stream.NumFrames;
+				}
+			}
+		}
+
+		if (!bValid)
+		{
+			NumFailed++;
+			continue;
+		}
+
+		const int64 RawBytes = FileFrames * File->GetFrameSize();
+		const double PerPassSeconds = DecodeSeconds / Passes;
+		UE_LOG(LogGhost, Display, TEXT("OK   %s: %d ghosts, %lld frames, %lld bytes (%.2f bytes/frame, %.2fx), decode %.1f MB/s %s"),
+			*FileName,
+			File->NumStreams(),
+			FileFrames,
+			File->GetFileSize(),
+			FileFrames > 0 ? (double)File->GetFileSize() / FileFrames : 0.0,
+			File->GetFileSize() > 0 ? (double)RawBytes / File->GetFileSize() : 0.0,
+			PerPassSeconds > 0.0 ? RawBytes / PerPassSeconds / (1024.0 * 1024.0) : 0.0,
+			File->IsMapped() ? TEXT("(mapped)") : TEXT("(loaded)"));
+
+		TotalFileBytes += File->GetFileSize();
+		TotalRawBytes += RawBytes;
+		TotalFrames += FileFrames;
+		TotalDecodeSeconds += PerPassSeconds;
+	}
+
+	UE_LOG(LogGhost, Display, TEXT("%d files, %d failed, %lld frames, %lld bytes on disk, %lld bytes decoded"),
+		FileNames.Num(), NumFailed, TotalFrames, TotalFileBytes, TotalRawBytes);
+	if (TotalDecodeSeconds > 0.0)
+	{
+		UE_LOG(LogGhost, Display, TEXT("Decode throughput: %.1f MB/s, %.0f frames/s"),
+			TotalRawBytes / TotalDecodeSeconds / (1024.0 * 1024.0), TotalFrames / TotalDecodeSeconds);
+	}
+
+	return NumFailed > 0 ? 1 : 0;
+}
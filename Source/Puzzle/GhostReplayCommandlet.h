@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "GhostReplayCommandlet.generated.h"
+
+/**
+ * Validates every .ghost file of a directory and reports size and decode throughput.
+ *
+ *   UnrealEditor-Cmd Puzzle.uproject -run=GhostReplay [-Dir=<path>] [-Passes=<n>]
+ *
+ * Dir defaults to Saved/Ghosts. Returns non zero when any file fails to validate.
+ */
+UCLASS()
+class PUZZLE_API UGhostReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UGhostReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
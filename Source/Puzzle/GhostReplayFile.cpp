@@ -0,0 +1,478 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GhostReplayFile.h"
+
+#include "GhostRecording.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	enum class EGhostReplayCompression : uint8
+	{
+		None,
+		Oodle
+	};
+
+	// magic + version + compression + reserved + stream count + chunk count + table offset
+	constexpr int64 HeaderSize = sizeof(uint32) + sizeof(uint16) + 2 * sizeof(uint8) + 2 * sizeof(uint32) + sizeof(uint64);
+
+	// Cada stream guarda o origin em double, os dois tempos e os três contadores
+	constexpr int64 StreamEntrySize = 3 * sizeof(double) + 2 * sizeof(float) + 3 * sizeof(uint32);
+	constexpr int64 ChunkEntrySize = sizeof(uint64) + 2 * sizeof(uint32) + sizeof(float);
+
+	// Chunks começam alinhados para os timestamps serem lidos direto do arquivo mapeado
+	constexpr int64 ChunkAlignment = 4;
+
+	struct FGhostReplayHeader
+	{
+		uint32 Magic = 0;
+		uint16 Version = 0;
+		uint8 Compression = 0;
+		uint8 Reserved = 0;
+		uint32 NumStreams = 0;
+		uint32 NumChunks = 0;
+		uint64 TableOffset = 0;
+
+		friend FArchive& operator<<(FArchive& Ar, FGhostReplayHeader& Header)
+		{
+			return Ar << Header.Magic << Header.Version << Header.Compression << Header.Reserved
+				<< Header.NumStreams << Header.NumChunks << Header.TableOffset;
+		}
+	};
+
+	FName GetCompressionFormat(uint8 Compression)
+	{
+		return Compression == (uint8)EGhostReplayCompression::Oodle ? NAME_Oodle : NAME_None;
+	}
+
+	/** Writes Num frames starting at First field by field into Out. */
+	void EncodeFrames(const FGhostRecording& Recording, int32 First, int32 Num, TArray<uint8>& Out)
+	{
+		Out.SetNumUninitialized(Num * FGhostReplayFile::GetFrameSize(FGhostReplayFile::Version), EAllowShrinking::No);
+
+		float* TimeStamps = reinterpret_cast<float*>(Out.GetData());
+		int32* Locations = reinterpret_cast<int32*>(TimeStamps + Num);
+		uint16* Rotations = reinterpret_cast<uint16*>(Locations + 3 * Num);
+		int16* Velocities = reinterpret_cast<int16*>(Rotations + 3 * Num);
+		int16* AngularVelocities = Velocities + 3 * Num;
+		uint8* Flags = reinterpret_cast<uint8*>(AngularVelocities + 3 * Num);
+
+		for (int32 i = 0; i < Num; i++)
+		{
+			const FGhostPackedFrame& Frame = Recording.GetPacked(First + i);
+			TimeStamps[i] = Frame.TimeStamp;
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				Locations[Axis * Num + i] = Frame.Location[Axis];
+				Rotations[Axis * Num + i] = Frame.Rotation[Axis];
+				Velocities[Axis * Num + i] = Frame.Velocity[Axis];
+				AngularVelocities[Axis * Num + i] = Frame.AngularVelocity[Axis];
+			}
+			Flags[i] = Frame.Flags;
+		}
+	}
+
+	void DecodeFrames(const uint8* In, int32 Num, uint16 FileVersion, FGhostRecording& Recording)
+	{
+		const float* TimeStamps = reinterpret_cast<const float*>(In);
+		// Até a versão 2 a posição era int16
+		const int32* Locations = FileVersion >= 3 ? reinterpret_cast<const int32*>(TimeStamps + Num) : nullptr;
+		const int16* ShortLocations = reinterpret_cast<const int16*>(TimeStamps + Num);
+		const uint16* Rotations = Locations
+			? reinterpret_cast<const uint16*>(Locations + 3 * Num)
+			: reinterpret_cast<const uint16*>(ShortLocations + 3 * Num);
+		const int16* Velocities = reinterpret_cast<const int16*>(Rotations + 3 * Num);
+		// Versão 1 não tem velocidade angular
+		const int16* AngularVelocities = FileVersion >= 2 ? Velocities + 3 * Num : nullptr;
+		const uint8* Flags = reinterpret_cast<const uint8*>(Velocities + (AngularVelocities ? 6 : 3) * Num);
+
+		for (int32 i = 0; i < Num; i++)
+		{
+			FGhostPackedFrame Frame;
+			Frame.TimeStamp = TimeStamps[i];
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				Frame.Location[Axis] = Locations ? Locations[Axis * Num + i] : ShortLocations[Axis * Num + i];
+				Frame.Rotation[Axis] = Rotations[Axis * Num + i];
+				Frame.Velocity[Axis] = Velocities[Axis * Num + i];
+				Frame.AngularVelocity[Axis] = AngularVelocities ? AngularVelocities[Axis * Num + i] : 0;
+			}
+			Frame.Flags = Flags[i];
+			Recording.AddPacked(Frame);
+		}
+	}
+}
+
+FArchive& operator<<(FArchive& Ar, FGhostReplayStream& Stream)
+{
+	// Sempre em double, independente de LWC
+	double Origin[3] = { Stream.Origin.X, Stream.Origin.Y, Stream.Origin.Z };
+	Ar << Origin[0] << Origin[1] << Origin[2];
+	Stream.Origin = FVector(Origin[0], Origin[1], Origin[2]);
+
+	return Ar << Stream.StartTime << Stream.EndTime << Stream.NumFrames << Stream.FirstChunk << Stream.NumChunks;
+}
+
+FArchive& operator<<(FArchive& Ar, FGhostReplayChunk& Chunk)
+{
+	return Ar << Chunk.Offset << Chunk.CompressedSize << Chunk.NumFrames << Chunk.StartTime;
+}
+
+void FGhostReplayFile::CompressRecording(const FGhostRecording& Recording, TArray<uint8>& Out)
+{
+	Out.Reset();
+	if (Recording.IsEmpty())
+	{
+		return;
+	}
+
+	TArray<uint8> Raw;
+	EncodeFrames(Recording, 0, Recording.Num(), Raw);
+
+	const FName Format = GetCompressionFormat((uint8)EGhostReplayCompression::Oodle);
+	int32 CompressedSize = FCompression::CompressMemoryBound(Format, Raw.Num());
+	TArray<uint8> Compressed;
+	Compressed.SetNumUninitialized(CompressedSize);
+	const bool bCompressed = FCompression::CompressMemory(Format, Compressed.GetData(), CompressedSize, Raw.GetData(), Raw.Num())
+		&& CompressedSize < Raw.Num();
+
+	FMemoryWriter Writer(Out);
+	uint16 BlobVersion = Version;
+	uint32 NumFrames = Recording.Num();
+	uint32 PayloadSize = bCompressed ? CompressedSize : Raw.Num();
+	FGhostReplayStream Stream;
+	Stream.Origin = Recording.GetOrigin();
+	Stream.StartTime = Recording.GetStartTime();
+	Stream.EndTime = Recording.GetEndTime();
+	Stream.NumFrames = NumFrames;
+	Stream.NumChunks = 1;
+	Writer << BlobVersion << Stream << PayloadSize;
+	Writer.Serialize(bCompressed ? Compressed.GetData() : Raw.GetData(), PayloadSize);
+}
+
+bool FGhostReplayFile::DecompressRecording(TArrayView<const uint8> In, FGhostRecording& Recording)
+{
+	FMemoryReaderView Reader(In);
+	uint16 BlobVersion = 0;
+	FGhostReplayStream Stream;
+	uint32 PayloadSize = 0;
+	Reader << BlobVersion << Stream << PayloadSize;
+
+	const int64 RawSize = (int64)Stream.NumFrames * GetFrameSize(BlobVersion);
+	if (Reader.IsError() || BlobVersion < MinVersion || BlobVersion > Version || Stream.NumFrames == 0
+		|| PayloadSize == 0 || PayloadSize > RawSize || Reader.Tell() + PayloadSize > In.Num())
+	{
+		UE_LOG(LogGhost, Warning, TEXT("Invalid ghost recording blob (%d bytes)"), In.Num());
+		return false;
+	}
+
+	const uint8* Payload = In.GetData() + Reader.Tell();
+	TArray<uint8> Raw;
+	if (PayloadSize < RawSize)
+	{
+		Raw.SetNumUninitialized(RawSize);
+		if (!FCompression::UncompressMemory(GetCompressionFormat((uint8)EGhostReplayCompression::Oodle), Raw.GetData(), RawSize, Payload, PayloadSize))
+		{
+			UE_LOG(LogGhost, Warning, TEXT("Ghost recording blob failed to decompress"));
+			return false;
+		}
+		Payload = Raw.GetData();
+	}
+	else if (!IsAligned(Payload, alignof(float)))
+	{
+		// Dentro do blob o payload não tem alinhamento garantido
+		Raw.Append(Payload, RawSize);
+		Payload = Raw.GetData();
+	}
+
+	Recording.ReserveFrames(Stream.NumFrames);
+	Recording.SetOrigin(Stream.Origin);
+	DecodeFrames(Payload, Stream.NumFrames, BlobVersion, Recording);
+	return true;
+}
+
+FGhostReplayFile::~FGhostReplayFile()
+{
+	// A região precisa sair antes do handle
+	MappedRegion.Reset();
+	MappedHandle.Reset();
+}
+
+FString FGhostReplayFile::ResolvePath(const FString& FileName)
+{
+	FString Result = FPaths::IsRelative(FileName) ? FPaths::ProjectSavedDir() / TEXT("Ghosts") / FileName : FileName;
+	if (FPaths::GetExtension(Result).IsEmpty())
+	{
+		Result += TEXT(".ghost");
+	}
+	return Result;
+}
+
+bool FGhostReplayFile::Save(const FString& Path, TArrayView<const FGhostRecording* const> Recordings, int32 FramesPerChunk)
+{
+	FramesPerChunk = FMath::Max(FramesPerChunk, 1);
+
+	const FString TempPath = Path + TEXT(".tmp");
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*TempPath));
+	if (!Writer)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("Could not open %s for writing"), *TempPath);
+		return false;
+	}
+
+	FGhostReplayHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.Compression = (uint8)EGhostReplayCompression::Oodle;
+	// Placeholder, reescrito no final com a tabela
+	*Writer << Header;
+
+	TArray<FGhostReplayStream> Streams;
+	TArray<FGhostReplayChunk> Chunks;
+	TArray<uint8> Raw;
+	TArray<uint8> Compressed;
+
+	const FName Format = GetCompressionFormat(Header.Compression);
+
+	for (const FGhostRecording* Recording : Recordings)
+	{
+		if (!Recording || Recording->IsEmpty())
+		{
+			continue;
+		}
+
+		FGhostReplayStream& Stream = Streams.AddDefaulted_GetRef();
+		Stream.Origin = Recording->GetOrigin();
+		Stream.StartTime = Recording->GetStartTime();
+		Stream.EndTime = Recording->GetEndTime();
+		Stream.NumFrames = Recording->Num();
+		Stream.FirstChunk = Chunks.Num();
+
+		for (int32 First = 0; First < Recording->Num(); First += FramesPerChunk)
+		{
+			const int32 Num = FMath::Min(FramesPerChunk, Recording->Num() - First);
+			EncodeFrames(*Recording, First, Num, Raw);
+
+			int32 CompressedSize = FCompression::CompressMemoryBound(Format, Raw.Num());
+			Compressed.SetNumUninitialized(CompressedSize, EAllowShrinking::No);
+			const bool bCompressed = FCompression::CompressMemory(Format, Compressed.GetData(), CompressedSize, Raw.GetData(), Raw.Num())
+				&& CompressedSize < Raw.Num();
+
+			const int64 Offset = Writer->Tell();
+			const int64 AlignedOffset = Align(Offset, ChunkAlignment);
+			for (int64 Pad = Offset; Pad < AlignedOffset; Pad++)
+			{
+				uint8 Zero = 0;
+				*Writer << Zero;
+			}
+
+			FGhostReplayChunk& Chunk = Chunks.AddDefaulted_GetRef();
+			Chunk.Offset = AlignedOffset;
+			Chunk.NumFrames = Num;
+			Chunk.StartTime = Recording->GetPacked(First).TimeStamp;
+
+			// Chunk que não comprime vai cru; o tamanho igual ao raw indica isso na leitura
+			if (bCompressed)
+			{
+				Chunk.CompressedSize = CompressedSize;
+				Writer->Serialize(Compressed.GetData(), CompressedSize);
+			}
+			else
+			{
+				Chunk.CompressedSize = Raw.Num();
+				Writer->Serialize(Raw.GetData(), Raw.Num());
+			}
+		}
+
+		Stream.NumChunks = Chunks.Num() - Stream.FirstChunk;
+	}
+
+	Header.NumStreams = Streams.Num();
+	Header.NumChunks = Chunks.Num();
+	Header.TableOffset = Writer->Tell();
+
+	for (FGhostReplayStream& Stream : Streams)
+	{
+		*Writer << Stream;
+	}
+	for (FGhostReplayChunk& Chunk : Chunks)
+	{
+		*Writer << Chunk;
+	}
+
+	Writer->Seek(0);
+	*Writer << Header;
+
+	const bool bWriteOk = Writer->Close() && !Writer->IsError();
+	Writer.Reset();
+
+	if (!bWriteOk || !IFileManager::Get().Move(*Path, *TempPath, true, true))
+	{
+		UE_LOG(LogGhost, Warning, TEXT("Failed to write ghost replay %s"), *Path);
+		IFileManager::Get().Delete(*TempPath);
+		return false;
+	}
+
+	UE_LOG(LogGhost, Log, TEXT("Saved %d ghosts (%d chunks) to %s"), Streams.Num(), Chunks.Num(), *Path);
+	return true;
+}
+
+TSharedPtr<FGhostReplayFile> FGhostReplayFile::Open(const FString& Path)
+{
+	TSharedPtr<FGhostReplayFile> File = MakeShareable(new FGhostReplayFile());
+	File->Path = Path;
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	File->MappedHandle.Reset(PlatformFile.OpenMapped(*Path));
+	if (File->MappedHandle)
+	{
+		File->MappedRegion.Reset(File->MappedHandle->MapRegion());
+	}
+
+	if (File->MappedRegion)
+	{
+		File->Data = TArrayView64<const uint8>(File->MappedRegion->GetMappedPtr(), File->MappedRegion->GetMappedSize());
+	}
+	else
+	{
+		File->MappedHandle.Reset();
+		if (!FFileHelper::LoadFileToArray(File->FileBytes, *Path))
+		{
+			UE_LOG(LogGhost, Warning, TEXT("Could not open ghost replay %s"), *Path);
+			return nullptr;
+		}
+		File->Data = File->FileBytes;
+	}
+
+	if (!File->ReadTables())
+	{
+		return nullptr;
+	}
+	return File;
+}
+
+bool FGhostReplayFile::ReadTables()
+{
+	if (Data.Num() < HeaderSize)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s is too small to be a ghost replay"), *Path);
+		return false;
+	}
+
+	FGhostReplayHeader Header;
+	{
+		TArrayView<const uint8> HeaderView(Data.GetData(), (int32)HeaderSize);
+		FMemoryReaderView Reader(HeaderView);
+		Reader << Header;
+	}
+
+	if (Header.Magic != Magic || Header.Version < MinVersion || Header.Version > Version)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s is not a ghost replay (magic %08x, version %d)"), *Path, Header.Magic, Header.Version);
+		return false;
+	}
+
+	if (Header.Compression > (uint8)EGhostReplayCompression::Oodle)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s uses unknown compression %d"), *Path, Header.Compression);
+		return false;
+	}
+	Compression = Header.Compression;
+	FileVersion = Header.Version;
+
+	const int64 TableSize = Header.NumStreams * StreamEntrySize + Header.NumChunks * ChunkEntrySize;
+	// Sem somar offsets do arquivo, um valor forjado daria a volta no uint64 e passaria
+	if (Header.TableOffset < (uint64)HeaderSize || Header.TableOffset > (uint64)Data.Num() || (uint64)TableSize > (uint64)Data.Num() - Header.TableOffset)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s has a truncated table"), *Path);
+		return false;
+	}
+
+	TArrayView<const uint8> TableView(Data.GetData() + Header.TableOffset, (int32)TableSize);
+	FMemoryReaderView Reader(TableView);
+
+	Streams.SetNum(Header.NumStreams);
+	for (FGhostReplayStream& Stream : Streams)
+	{
+		Reader << Stream;
+	}
+	Chunks.SetNum(Header.NumChunks);
+	for (FGhostReplayChunk& Chunk : Chunks)
+	{
+		Reader << Chunk;
+	}
+
+	// Valida tudo agora para o DecodeChunk não precisar checar limites
+	for (const FGhostReplayChunk& Chunk : Chunks)
+	{
+		const uint64 RawSize = (uint64)Chunk.NumFrames * GetFrameSize();
+		const bool bRawOnly = Compression == (uint8)EGhostReplayCompression::None;
+		if (Chunk.NumFrames == 0 || Chunk.CompressedSize == 0 || Chunk.CompressedSize > RawSize
+			|| (bRawOnly && Chunk.CompressedSize != RawSize)
+			|| Chunk.Offset < (uint64)HeaderSize || Chunk.Offset % ChunkAlignment != 0
+			|| Chunk.Offset > Header.TableOffset || Chunk.CompressedSize > Header.TableOffset - Chunk.Offset)
+		{
+			UE_LOG(LogGhost, Warning, TEXT("%s has an invalid chunk at offset %llu"), *Path, Chunk.Offset);
+			return false;
+		}
+	}
+
+	for (const FGhostReplayStream& Stream : Streams)
+	{
+		if ((uint64)Stream.FirstChunk + Stream.NumChunks > (uint64)Chunks.Num())
+		{
+			UE_LOG(LogGhost, Warning, TEXT("%s has a stream pointing past its chunk table"), *Path);
+			return false;
+		}
+
+		uint64 NumFrames = 0;
+		for (uint32 ChunkIndex = Stream.FirstChunk; ChunkIndex < Stream.FirstChunk + Stream.NumChunks; ChunkIndex++)
+		{
+			NumFrames += Chunks[ChunkIndex].NumFrames;
+		}
+		if (NumFrames != Stream.NumFrames)
+		{
+			UE_LOG(LogGhost, Warning, TEXT("%s has a stream with %u frames but chunks holding %llu"), *Path, Stream.NumFrames, NumFrames);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FGhostReplayFile::DecodeChunk(int32 ChunkIndex, FGhostRecording& Recording) const
+{
+	if (!Chunks.IsValidIndex(ChunkIndex))
+	{
+		return false;
+	}
+
+	const FGhostReplayChunk& Chunk = Chunks[ChunkIndex];
+	const int32 RawSize = Chunk.NumFrames * GetFrameSize();
+	const uint8* Payload = Data.GetData() + Chunk.Offset;
+
+	if ((int32)Chunk.CompressedSize == RawSize)
+	{
+		// Guardado sem compressão, lê direto do arquivo mapeado
+		DecodeFrames(Payload, Chunk.NumFrames, FileVersion, Recording);
+		return true;
+	}
+
+	Scratch.SetNumUninitialized(RawSize, EAllowShrinking::No);
+	if (!FCompression::UncompressMemory(GetCompressionFormat(Compression), Scratch.GetData(), RawSize, Payload, Chunk.CompressedSize))
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s: chunk %d failed to decompress"), *Path, ChunkIndex);
+		return false;
+	}
+
+	DecodeFrames(Scratch.GetData(), Chunk.NumFrames, FileVersion, Recording);
+	return true;
+}
@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FGhostRecording;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Per-ghost entry of a replay file. The frames of a ghost are split in
+ * NumChunks consecutive chunks starting at FirstChunk.
+ */
+struct FGhostReplayStream
+{
+	FVector Origin = FVector::ZeroVector;
+	float StartTime = 0.0f;
+	float EndTime = 0.0f;
+	uint32 NumFrames = 0;
+	uint32 FirstChunk = 0;
+	uint32 NumChunks = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FGhostReplayStream& Stream);
+};
+
+/** Where a chunk lives in the file and what it holds. */
+struct FGhostReplayChunk
+{
+	uint64 Offset = 0;
+	// Equal to the raw size when the chunk did not compress and was stored as is
+	uint32 CompressedSize = 0;
+	uint32 NumFrames = 0;
+	float StartTime = 0.0f;
+
+	friend FArchive& operator<<(FArchive& Ar, FGhostReplayChunk& Chunk);
+};
+
+/**
+ * Ghost replay file (.ghost):
+ *
+ *   header | chunk payloads ... | stream table | chunk table
+ *
+ * Each chunk holds up to FramesPerChunk packed frames of one ghost, stored field by field
+ * (all timestamps, then all locations, ...) so the compressor sees similar bytes together.
+ * The file is memory mapped when the platform allows it and chunks are only decoded
+ * when DecodeChunk() asks for them, so long recordings can be streamed during playback.
+ */
+class PUZZLE_API FGhostReplayFile
+{
+public:
+	static constexpr uint32 Magic = 0x54534847; // "GHST"
+	// 2: angular velocity. Version 1 files are still read, without it
+	// 3: 32-bit locations. Older files keep their 16-bit ones
+	static constexpr uint16 Version = 3;
+	static constexpr uint16 MinVersion = 1;
+	static constexpr int32 DefaultFramesPerChunk = 256;
+
+	/** Bytes of one frame inside a decompressed chunk of a file written with FileVersion. */
+	static constexpr int32 GetFrameSize(uint16 FileVersion)
+	{
+		return sizeof(float) + 3 * (FileVersion >= 3 ? sizeof(int32) : sizeof(int16)) + (FileVersion >= 2 ? 9 : 6) * sizeof(int16) + sizeof(uint8);
+	}
+
+	~FGhostReplayFile();
+
+	/** Saved/Ghosts/FileName.ghost for relative names, absolute paths are kept. */
+	static FString ResolvePath(const FString& FileName);
+
+	/** Writes every recording to Path. The file is replaced only once it was fully written. */
+	static bool Save(const FString& Path, TArrayView<const FGhostRecording* const> Recordings, int32 FramesPerChunk = DefaultFramesPerChunk);
+
+	/**
+	 * Whole recording as one self-contained compressed blob (origin, frame count, frames),
+	 * same frame layout as a file chunk. Used to send recordings over the network.
+	 */
+	static void CompressRecording(const FGhostRecording& Recording, TArray<uint8>& Out);
+	static bool DecompressRecording(TArrayView<const uint8> In, FGhostRecording& Recording);
+
+	/** Maps Path and validates its header and tables; no frame is decoded yet. */
+	static TSharedPtr<FGhostReplayFile> Open(const FString& Path);
+
+	int32 NumStreams() const { return Streams.Num(); }
+	const FGhostReplayStream& GetStream(int32 StreamIndex) const { return Streams[StreamIndex]; }
+
+	int32 NumChunks() const { return Chunks.Num(); }
+	const FGhostReplayChunk& GetChunk(int32 ChunkIndex) const { return Chunks[ChunkIndex]; }
+
+	/** Decompresses ChunkIndex and appends its frames to Recording. */
+	bool DecodeChunk(int32 ChunkIndex, FGhostRecording& Recording) const;
+
+	int64 GetFileSize() const { return Data.Num(); }
+	uint16 GetVersion() const { return FileVersion; }
+	int32 GetFrameSize() const { return GetFrameSize(FileVersion); }
+	bool IsMapped() const { return MappedRegion.IsValid(); }
+	const FString& GetPath() const { return Path; }
+
+private:
+	FGhostReplayFile() = default;
+
+	bool ReadTables();
+
+	FString Path;
+	uint16 FileVersion = Version;
+	uint8 Compression = 0;
+
+	TUniquePtr<IMappedFileHandle> MappedHandle;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	// Fallback when the platform cannot map files
+	TArray64<uint8> FileBytes;
+	TArrayView64<const uint8> Data;
+
+	TArray<FGhostReplayStream> Streams;
+	TArray<FGhostReplayChunk> Chunks;
+
+	// Reused by DecodeChunk so streaming does not allocate per chunk
+	mutable TArray<uint8> Scratch;
+};
@@ -1,19 +1,120 @@
 #include "GhostReplayer.h"
 
+#include "FollowerTimer.h"
 #include "GhostComponent.h"
+#include "GhostProxy.h"
+#include "GhostReplayFile.h"
+#include "Pickup.h"
 #include "PuzzleCharacter.h"
 #include "Components/BoxComponent.h"
+#include "Dom/JsonObject.h"
 #include "Engine/World.h"
+#include "EngineUtils.h"
 #include "GameFramework/Actor.h"
 #include "TimerManager.h"
 #include "Character/ALSPlayerCameraManager.h"
 #include "GameFramework/Character.h"
+#include "GameFramework/GameStateBase.h"
 #include "GameFramework/PlayerState.h"
+#include "Engine/NetDriver.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Net/UnrealNetwork.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	/** Logs the FGhostNetStats of every replayer and writes them to Saved/Ghosts/NetReport.json. */
+	void LogGhostNetReport(UWorld* World)
+	{
+		const double Seconds = FMath::Max(World->GetTimeSeconds(), 1.0);
+		const UNetDriver* NetDriver = World->GetNetDriver();
+
+		TArray<TSharedPtr<FJsonValue>> Entries;
+		for (TActorIterator<AGhostReplayer> It(World); It; ++It)
+		{
+			const FGhostNetStats Stats = It->GetNetStats();
+			UE_LOG(LogGhost, Display, TEXT("%s: %d cycles, %d recordings, %d RPCs, %lld raw -> %lld compressed bytes (%.2fx), %lld bytes sent (%.1f B/s), per-frame replication estimate %lld bytes (%.1fx more)"),
+				*It->GetName(),
+				Stats.Cycles,
+				Stats.RecordingsSent,
+				Stats.RPCs,
+				Stats.RawBytes,
+				Stats.PayloadBytes,
+				Stats.PayloadBytes > 0 ? (double)Stats.RawBytes / Stats.PayloadBytes : 0.0,
+				Stats.BytesSent,
+				Stats.BytesSent / Seconds,
+				Stats.PerFrameEstimateBytes,
+				Stats.BytesSent > 0 ? (double)Stats.PerFrameEstimateBytes / Stats.BytesSent : 0.0);
+
+			TSharedRef<FJsonObject> Entry = MakeShared<FJsonObject>();
+			Entry->SetStringField(TEXT("Replayer"), It->GetName());
+			Entry->SetNumberField(TEXT("Cycles"), Stats.Cycles);
+			Entry->SetNumberField(TEXT("RecordingsSent"), Stats.RecordingsSent);
+			Entry->SetNumberField(TEXT("RPCs"), Stats.RPCs);
+			Entry->SetNumberField(TEXT("RawBytes"), Stats.RawBytes);
+			Entry->SetNumberField(TEXT("PayloadBytes"), Stats.PayloadBytes);
+			Entry->SetNumberField(TEXT("BytesSent"), Stats.BytesSent);
+			Entry->SetNumberField(TEXT("BytesPerSecond"), Stats.BytesSent / Seconds);
+			Entry->SetNumberField(TEXT("PerFrameEstimateBytes"), Stats.PerFrameEstimateBytes);
+			Entries.Add(MakeShared<FJsonValueObject>(Entry));
+		}
+
+		TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+		Report->SetNumberField(TEXT("Seconds"), Seconds);
+		Report->SetNumberField(TEXT("Clients"), NetDriver ? NetDriver->ClientConnections.Num() : 0);
+		Report->SetArrayField(TEXT("Replayers"), Entries);
+
+		FString Json;
+		const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		FJsonSerializer::Serialize(Report, Writer);
+
+		const FString Path = FGhostReplayFile::ResolvePath(TEXT("NetReport.json"));
+		if (FFileHelper::SaveStringToFile(Json, *Path))
+		{
+			UE_LOG(LogGhost, Display, TEXT("Ghost net report written to %s"), *Path);
+		}
+	}
+
+	FAutoConsoleCommandWithWorld GhostNetReportCommand(
+		TEXT("Ghost.NetReport"),
+		TEXT("Logs the bandwidth each ghost replayer spent sending recordings to clients and writes it to Saved/Ghosts/NetReport.json. Run on the server."),
+		FConsoleCommandWithWorldDelegate::CreateStatic(&LogGhostNetReport));
+
+	/**
+	 * With -GhostNetReport=<Seconds> on the server command line, writes the report that many seconds
+	 * into play and quits, so a headless -server / -game session measures itself:
+	 *
+	 *   UnrealEditor Puzzle.uproject <Map> -server -log -GhostNetReport=120
+	 *   UnrealEditor Puzzle.uproject 127.0.0.1 -game -windowed -ResX=640 -ResY=360   (twice)
+	 */
+	void ScheduleGhostNetReport(UWorld* World)
+	{
+		static TWeakObjectPtr<UWorld> ScheduledWorld;
+
+		float Seconds = 0.0f;
+		if (!World || ScheduledWorld == World || !FParse::Value(FCommandLine::Get(), TEXT("GhostNetReport="), Seconds))
+		{
+			return;
+		}
+		ScheduledWorld = World;
+
+		FTimerHandle Handle;
+		World->GetTimerManager().SetTimer(Handle, FTimerDelegate::CreateWeakLambda(World, [World]()
+		{
+			LogGhostNetReport(World);
+			FPlatformMisc::RequestExit(false);
+		}), FMath::Max(Seconds, 1.0f), false);
+	}
+}
 
 AGhostReplayer::AGhostReplayer()
 {
 	PrimaryActorTick.bCanEverTick = true;
+	// Só liga o tick quando algum candidato se move dentro do Detection
+	PrimaryActorTick.bStartWithTickEnabled = false;
 
 	Mesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Mesh"));
 	Mesh->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
@@ -28,12 +129,255 @@ AGhostReplayer::AGhostReplayer()
 	BoxMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("BoxMesh"));
 	BoxMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 	BoxMesh->SetupAttachment(Detection);
-	
+
+	// Só a lista de rastreados e os RPCs de ciclo; os ghosts em si nunca replicam
+	bReplicates = true;
+	bAlwaysRelevant = true;
+	SetNetUpdateFrequency(10.0f);
+
+	GhostProxyClass = AGhostProxy::StaticClass();
+	TrackableClasses.Add(ACharacter::StaticClass());
+	TrackableClasses.Add(APickup::StaticClass());
 }
 
 void AGhostReplayer::BeginPlay()
 {
 	Super::BeginPlay();
+
+	PrewarmPools();
+
+	if (HasAuthority())
+	{
+		ScheduleGhostNetReport(GetWorld());
+	}
+}
+
+void AGhostReplayer::PrewarmPools()
+{
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return;
+	}
+
+	// Spawn tudo agora para não ter spawn nem GC na virada de cada captureTime
+	const int32 NumGhosts = PoolPrewarmActors * (DefaultReplayCount + 1);
+	for (int32 i = GhostPool.Num(); i < NumGhosts; i++)
+	{
+		if (AGhostProxy* Proxy = SpawnPooledProxy())
+		{
+			GhostPool.Add(Proxy);
+		}
+	}
+
+	if (TargetIconActorClass)
+	{
+		for (int32 i = TimerIconPool.Num(); i < PoolPrewarmActors; i++)
+		{
+			if (AActor* TimerIcon = World->SpawnActor<AActor>(TargetIconActorClass, GetActorTransform()))
+			{
+				TimerIcon->SetActorHiddenInGame(true);
+				TimerIconPool.Add(TimerIcon);
+			}
+		}
+	}
+}
+
+AGhostProxy* AGhostReplayer::SpawnPooledProxy()
+{
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return nullptr;
+	}
+
+	AGhostProxy* Proxy = World->SpawnActor<AGhostProxy>(GhostProxyClass ? *GhostProxyClass : AGhostProxy::StaticClass(), GetActorTransform());
+	if (!Proxy)
+	{
+		return nullptr;
+	}
+
+	// O componente vive junto com o proxy; o BeginPlay dele já esconde o ator
+	UGhostComponent* GhostComponent = NewObject<UGhostComponent>(Proxy);
+	GhostComponent->RegisterComponent();
+	Proxy->AddOwnedComponent(GhostComponent);
+	GhostComponent->ParentGhostReplayer = this;
+	GhostRegistry.Add(Proxy, GhostComponent);
+	return Proxy;
+}
+
+AGhostProxy* AGhostReplayer::PopPooledProxy()
+{
+	while (GhostPool.Num() > 0)
+	{
+		AGhostProxy* Proxy = GhostPool.Pop(EAllowShrinking::No);
+		if (IsValid(Proxy))
+		{
+			return Proxy;
+		}
+	}
+	return SpawnPooledProxy();
+}
+
+AActor* AGhostReplayer::AcquireGhost(AActor* Actor)
+{
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return nullptr;
+	}
+
+	if (ACharacter* Character = Cast<ACharacter>(Actor))
+	{
+		// Só precisamos de mesh e cápsula para reproduzir, não de outro personagem ALS inteiro
+		AGhostProxy* Proxy = PopPooledProxy();
+		if (!Proxy)
+		{
+			return nullptr;
+		}
+
+		Proxy->SetActorTransform(Actor->GetActorTransform());
+		if (Proxy->InitializeFromCharacter(Character))
+		{
+			ApplyGhostMaterial(Proxy);
+		}
+		return Proxy;
+	}
+
+	// Props e pickups: o mesh estático basta, também vem do pool
+	if (AGhostProxy* Proxy = PopPooledProxy())
+	{
+		bool bMeshFound = false;
+		const bool bMeshChanged = Proxy->InitializeFromActor(Actor, bMeshFound);
+		if (bMeshFound)
+		{
+			Proxy->SetActorTransform(Actor->GetActorTransform());
+			if (bMeshChanged)
+			{
+				ApplyGhostMaterial(Proxy);
+			}
+			return Proxy;
+		}
+		GhostPool.Add(Proxy);
+	}
+
+	// Deferred: a tag precisa existir antes do primeiro overlap do clone com o Detection
+	AActor* Ghost = World->SpawnActorDeferred<AActor>(Actor->GetClass(), Actor->GetActorTransform(), nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (!Ghost)
+	{
+		return nullptr;
+	}
+	// Clones não são AGhostProxy; a tag impede que este ou outro replayer rastreie o ghost
+	Ghost->Tags.AddUnique("Untrackable");
+	Ghost->FinishSpawning(Actor->GetActorTransform());
+
+	// O replay move o clone direto pelo transform
+	TArray<UPrimitiveComponent*> Primitives;
+	Ghost->GetComponents<UPrimitiveComponent>(Primitives);
+	for (UPrimitiveComponent* Primitive : Primitives)
+	{
+		Primitive->SetSimulatePhysics(false);
+	}
+
+	UGhostComponent* GhostComponent = NewObject<UGhostComponent>(Ghost);
+	GhostComponent->RegisterComponent();
+	Ghost->AddOwnedComponent(GhostComponent);
+	GhostRegistry.Add(Ghost, GhostComponent);
+	ApplyGhostMaterial(Ghost);
+	return Ghost;
+}
+
+void AGhostReplayer::ApplyGhostMaterial(AActor* Ghost) const
+{
+	if (!GhostMaterial || !Ghost)
+	{
+		return;
+	}
+
+	TArray<UMeshComponent*> MeshComps;
+	Ghost->GetComponents<UMeshComponent>(MeshComps);
+
+	for (UMeshComponent* MeshComp : MeshComps)
+	{
+		if (!MeshComp) continue;
+		const int32 NumMats = MeshComp->GetNumMaterials();
+		for (int32 i = 0; i < NumMats; i++)
+		{
+			MeshComp->SetMaterial(i, GhostMaterial);
+		}
+	}
+}
+
+void AGhostReplayer::ReleaseGhost(AActor* Ghost)
+{
+	if (!Ghost)
+	{
+		return;
+	}
+
+	UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost);
+	if (GhostComponent)
+	{
+		if (FGhostsArray* GhostsArray = GhostActors.Find(GhostComponent->FollowTarget))
+		{
+			GhostsArray->Ghosts.Remove(Ghost);
+		}
+		GhostComponent->StopGhost();
+		GhostComponent->FollowTarget = nullptr;
+	}
+
+	AGhostProxy* Proxy = Cast<AGhostProxy>(Ghost);
+	if (Proxy && GhostComponent && !IsActorBeingDestroyed())
+	{
+		GhostPool.Add(Proxy);
+	}
+	else
+	{
+		GhostRegistry.Remove(Ghost);
+		Ghost->Destroy();
+	}
+}
+
+AActor* AGhostReplayer::AcquireTimerIcon(const FVector& Location, const FRotator& Rotation)
+{
+	while (TimerIconPool.Num() > 0)
+	{
+		AActor* TimerIcon = TimerIconPool.Pop(EAllowShrinking::No);
+		if (IsValid(TimerIcon))
+		{
+			TimerIcon->SetActorLocationAndRotation(Location, Rotation);
+			TimerIcon->SetActorHiddenInGame(false);
+			return TimerIcon;
+		}
+	}
+
+	UWorld* World = GetWorld();
+	if (!World || !TargetIconActorClass)
+	{
+		return nullptr;
+	}
+	return World->SpawnActor<AActor>(TargetIconActorClass, Location, Rotation);
+}
+
+void AGhostReplayer::ReleaseTimerIcon(AActor* TimerIcon)
+{
+	if (!IsValid(TimerIcon))
+	{
+		return;
+	}
+
+	if (IsActorBeingDestroyed())
+	{
+		TimerIcon->Destroy();
+		return;
+	}
+
+	TimerIcon->SetActorHiddenInGame(true);
+	if(AFollowerTimer* Timer = Cast<AFollowerTimer>(TimerIcon))
+	{
+		Timer->UpdatePercentage(0.0f);
+	}
+	TimerIconPool.Add(TimerIcon);
 }
 
 void AGhostReplayer::SetEnabled(bool bEnabled)
@@ -62,101 +406,179 @@ void AGhostReplayer::SetEnabled(bool bEnabled)
 		}
         
 		// Limpa também os overlapping actors
+		TArray<AActor*> Candidates = OverlappingActors;
+		for (AActor* Candidate : Candidates)
+		{
+			RemoveCandidate(Candidate);
+		}
 		OverlappingActors.Empty();
 	}
+	else
+	{
+		// Quem já estava dentro enquanto desabilitado não vai gerar BeginOverlap de novo
+		TArray<AActor*> Overlapping;
+		Detection->GetOverlappingActors(Overlapping);
+		for (AActor* Actor : Overlapping)
+		{
+			NotifyActorBeginOverlap(Actor);
+		}
+	}
 }
 
 void AGhostReplayer::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	if (!bIsEnabled)
+	// Só reavalia quem se moveu desde o último tick
+	TArray<TWeakObjectPtr<AActor>> Dirty = DirtyCandidates.Array();
+	DirtyCandidates.Reset();
+
+	if (bIsEnabled)
 	{
-		return;
+		for (const TWeakObjectPtr<AActor>& WeakActor : Dirty)
+		{
+			AActor* Actor = WeakActor.Get();
+			if (Actor && !TrackedActors.Contains(Actor) && OverlappingActors.Contains(Actor) && IsFullyInside(Actor))
+			{
+				StartTrackingActor(Actor);
+			}
+		}
 	}
 
-	FVector BoxExtent = Detection->GetScaledBoxExtent();
-	FVector BoxLocation = Detection->GetComponentLocation();
+	if (DirtyCandidates.Num() == 0)
+	{
+		SetActorTickEnabled(false);
+	}
+}
 
-	TArray<AActor*> FullyOverlappingActors;
+bool AGhostReplayer::IsFullyInside(const AActor* Actor) const
+{
+	// Testa os cantos no espaço local do Detection, assim um volume rotacionado também funciona
+	const FBox ActorBounds = Actor->GetComponentsBoundingBox();
+	if (!ActorBounds.IsValid)
+	{
+		return false;
+	}
+
+	const FTransform& BoxTransform = Detection->GetComponentTransform();
+	const FVector BoxExtent = Detection->GetUnscaledBoxExtent();
 
-	for (AActor* Actor : OverlappingActors)
+	FVector Corners[8];
+	ActorBounds.GetVertices(Corners);
+	for (const FVector& Corner : Corners)
 	{
-		if (!Actor)
+		const FVector Local = BoxTransform.InverseTransformPosition(Corner);
+		if (FMath::Abs(Local.X) > BoxExtent.X ||
+			FMath::Abs(Local.Y) > BoxExtent.Y ||
+			FMath::Abs(Local.Z) > BoxExtent.Z)
 		{
-			continue;
+			return false;
+		}
+	}
+	return true;
+}
+
+void AGhostReplayer::StartTrackingActor(AActor* Actor)
+{
+	// Rastreado não precisa mais de avaliação de contenção
+	if (USceneComponent* Root = Actor->GetRootComponent())
+	{
+		if (FDelegateHandle* Handle = CandidateMoveHandles.Find(Actor))
+		{
+			Root->TransformUpdated.Remove(*Handle);
 		}
+	}
+	CandidateMoveHandles.Remove(Actor);
+
+	SetTrackedPostProcess(Actor, true);
+	ReplicatedTrackedActors.AddUnique(Actor);
+
+	// Adicione o ator à lista de rastreados
+	TrackedActors.Add(Actor, Actor->GetActorTransform());
+	SpawnGhost(Actor);
+
+	// Configure o timer específico para este ator
+	FTimerHandle& ActorTimer = ActorTimers.FindOrAdd(Actor);
+	GetWorld()->GetTimerManager().SetTimer(ActorTimer, [this, Actor]()
+	{
+		StartReplay(Actor);
+		RestartActorPosition(Actor);
+	}, captureTime, true);
+}
 
-		FBox ActorBounds = Actor->GetComponentsBoundingBox();
-		FVector ActorMin = ActorBounds.Min;
-		FVector ActorMax = ActorBounds.Max;
+void AGhostReplayer::SetTrackedPostProcess(AActor* Actor, bool bTracked) const
+{
+	APuzzleCharacter* Character = Cast<APuzzleCharacter>(Actor);
+	// Só o jogador local vê o efeito; o servidor não mexe na câmera de um cliente remoto
+	if (!Character || !Character->IsLocallyControlled())
+	{
+		return;
+	}
+
+	Character->CameraComponent->PostProcessSettings.WeightedBlendables.Array.Empty();
+	if (bTracked)
+	{
+		Character->CameraComponent->PostProcessSettings.WeightedBlendables.Array.Add(FWeightedBlendable(1.0f, PostProcessMaterial));
+	}
 
-		// Verifique se o ator está completamente dentro da área
-		if (ActorMin.X >= BoxLocation.X - BoxExtent.X &&
-			ActorMax.X <= BoxLocation.X + BoxExtent.X &&
-			ActorMin.Y >= BoxLocation.Y - BoxExtent.Y &&
-			ActorMax.Y <= BoxLocation.Y + BoxExtent.Y &&
-			ActorMin.Z >= BoxLocation.Z - BoxExtent.Z &&
-			ActorMax.Z <= BoxLocation.Z + BoxExtent.Z)
+	// O CameraManager certo é o do controller deste personagem, não o índice do PlayerId
+	APlayerController* PlayerController = Cast<APlayerController>(Character->GetController());
+	if (PlayerController)
+	{
+		if (AALSPlayerCameraManager* ALSManager = Cast<AALSPlayerCameraManager>(PlayerController->PlayerCameraManager))
 		{
-			FullyOverlappingActors.Add(Actor);
+			ALSManager->bUpdatePostProcessSettings = true;
 		}
 	}
+}
 
-	for (AActor* FullyOverlappingActor : FullyOverlappingActors)
+void AGhostReplayer::AddCandidate(AActor* Actor)
+{
+	OverlappingActors.AddUnique(Actor);
+
+	if (!CandidateMoveHandles.Contains(Actor))
 	{
-		if (!TrackedActors.Contains(FullyOverlappingActor))
+		if (USceneComponent* Root = Actor->GetRootComponent())
 		{
-			if (FullyOverlappingActor->IsA(ACharacter::StaticClass()))
-			{
-				APuzzleCharacter* Character = Cast<APuzzleCharacter>(FullyOverlappingActor);
-				if (Character)
-				{
-					Character->CameraComponent->PostProcessSettings.WeightedBlendables.Array.Empty();
-					Character->CameraComponent->PostProcessSettings.WeightedBlendables.Array.Add(FWeightedBlendable(1.0f, PostProcessMaterial));
-					// Obtém o PlayerController associado ao Character
-					APlayerController* PlayerController = Cast<APlayerController>(Character->GetController());
-					if (PlayerController)
-					{
-						// Obtém o índice do PlayerController no mundo
-						int32 PlayerIndex = PlayerController->GetLocalPlayer()->GetControllerId();
-
-						// Obtém o CameraManager correto usando o índice do PlayerController
-						APlayerCameraManager* Manager = UGameplayStatics::GetPlayerCameraManager(GetWorld(), PlayerIndex);
-						if (Manager)
-						{
-							// Cast para AALSPlayerCameraManager
-							if (AALSPlayerCameraManager* ALSManager = Cast<AALSPlayerCameraManager>(Manager))
-							{
-								// Limpa e adiciona o material no PostProcess
-								ALSManager->bUpdatePostProcessSettings = true;
-							}
-						}
-					}
-				}
-			}
+			CandidateMoveHandles.Add(Actor, Root->TransformUpdated.AddUObject(this, &AGhostReplayer::OnCandidateMoved));
+		}
+	}
 
-			
-			// Adicione o ator à lista de rastreados
-			TrackedActors.Add(FullyOverlappingActor, FullyOverlappingActor->GetActorTransform());
-			SpawnGhost(FullyOverlappingActor);
+	// Avalia uma vez mesmo que o ator entre parado
+	DirtyCandidates.Add(Actor);
+	SetActorTickEnabled(true);
+}
 
-			// Configure o timer específico para este ator
-			FTimerHandle& ActorTimer = ActorTimers.FindOrAdd(FullyOverlappingActor);
-			GetWorld()->GetTimerManager().SetTimer(ActorTimer, [this, FullyOverlappingActor]()
-			{
-				StartReplay(FullyOverlappingActor);
-				RestartActorPosition(FullyOverlappingActor);
-			}, captureTime, true);
+void AGhostReplayer::RemoveCandidate(AActor* Actor)
+{
+	OverlappingActors.Remove(Actor);
+	DirtyCandidates.Remove(Actor);
+
+	FDelegateHandle Handle;
+	if (CandidateMoveHandles.RemoveAndCopyValue(Actor, Handle) && Actor)
+	{
+		if (USceneComponent* Root = Actor->GetRootComponent())
+		{
+			Root->TransformUpdated.Remove(Handle);
 		}
 	}
 }
 
+void AGhostReplayer::OnCandidateMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	if (UpdatedComponent)
+	{
+		DirtyCandidates.Add(UpdatedComponent->GetOwner());
+		SetActorTickEnabled(true);
+	}
+}
+
 void AGhostReplayer::NotifyActorBeginOverlap(AActor* OtherActor)
 {
 	Super::NotifyActorBeginOverlap(OtherActor);
 
-	if (!bIsEnabled)
+	// Rastreamento e captura só no servidor, clientes recebem as gravações prontas
+	if (!bIsEnabled || !HasAuthority())
 	{
 		return;
 	}
@@ -165,19 +587,14 @@ void AGhostReplayer::NotifyActorBeginOverlap(AActor* OtherActor)
 	{
 		OtherActor = OtherActor->GetParentActor();
 	}
-	FTimerHandle DelayHandle;
-	GetWorld()->GetTimerManager().SetTimer(DelayHandle, [this, OtherActor]()
+
+	if (!OtherActor || OtherActor == this || IsGhostActor(OtherActor) || TrackedActors.Contains(OtherActor) || OtherActor->Tags.Contains("Untrackable") || !IsTrackableActor(OtherActor))
 	{
-		//must be a Character
-		if (!OtherActor || IsGhostActor(OtherActor) || TrackedActors.Contains(OtherActor) || OtherActor->Tags.Contains("Untrackable") || !OtherActor->IsA(ACharacter::StaticClass()))
-		{
-			return;
-		}
+		return;
+	}
 
-		// Adicione à lista de potencialmente rastreados
-		OverlappingActors.AddUnique(OtherActor);	
-	}, 0.1f, false);
-	
+	// Adicione à lista de potencialmente rastreados
+	AddCandidate(OtherActor);
 }
 
 
@@ -197,10 +614,7 @@ void AGhostReplayer::NotifyActorEndOverlap(AActor* OtherActor)
 	}
 
 	// Pare de rastrear o ator
-	if (OverlappingActors.Contains(OtherActor))
-	{
-		OverlappingActors.Remove(OtherActor);
-	}
+	RemoveCandidate(OtherActor);
 
 	if (TrackedActors.Contains(OtherActor))
 	{
@@ -214,32 +628,15 @@ void AGhostReplayer::StopTrackingActor(AActor* Actor)
 	if (!Actor) return;
 
 	// Remova da lista de atores sobrepostos
-	OverlappingActors.Remove(Actor);
+	RemoveCandidate(Actor);
 	
 
 	// Remova da lista de atores rastreados
 	if (TrackedActors.Contains(Actor))
 	{
-		if (Actor->IsA(ACharacter::StaticClass()))
-		{
-			APuzzleCharacter* Character = Cast<APuzzleCharacter>(Actor);
-			if (Character)
-			{
-				Character->CameraComponent->PostProcessSettings.WeightedBlendables.Array.Empty();
-				int PlayerID = Character->GetPlayerState()->GetPlayerId();
-				APlayerCameraManager* manager = UGameplayStatics::GetPlayerCameraManager(GetWorld(), PlayerID);
-				if (manager)
-				{
-					//cast to AALSPlayerCameraManager
-					if(AALSPlayerCameraManager* alsManager = Cast<AALSPlayerCameraManager>(manager))
-					{
-						alsManager->bUpdatePostProcessSettings = true;
-					}
-					
-				}
-				
-			}
-		}
+		SetTrackedPostProcess(Actor, false);
+		ReplicatedTrackedActors.Remove(Actor);
+
 		// Limpe e remova o timer associado ao ator
 		if (ActorTimers.Contains(Actor))
 		{
@@ -260,35 +657,57 @@ void AGhostReplayer::StartReplay(AActor* Actor)
 {
 	if (TrackedActors.Contains(Actor))
 	{
+		SendCycle(Actor);
+
 		// Reproduza os ghosts deste ator
 		if (GhostActors.Contains(Actor))
 		{
-			int i = 0;
-			for (AActor* Ghost : GhostActors[Actor].Ghosts)
+			// Cópia: ghosts que passaram do ReplayCount voltam pro pool e saem do array
+			TArray<AActor*> Ghosts = GhostActors[Actor].Ghosts;
+			for (AActor* Ghost : Ghosts)
 			{
-				if (Ghost)
+				UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost);
+				if (IsValid(Ghost) && GhostComponent)
 				{
-					UGhostComponent* GhostComponent = Ghost->FindComponentByClass<UGhostComponent>();
-					if (GhostComponent)
-					{
-						GhostComponent->StartReplay();
-					}
+					GhostComponent->StartReplay();
 				} else
 				{
-					//remove ghost from array using index
-					GhostActors[Actor].Ghosts.RemoveAt(i);
+					GhostActors[Actor].Ghosts.Remove(Ghost);
+					GhostRegistry.Remove(Ghost);
 				}
-				i++;
 			}
 		}
 	}
 }
 
+bool AGhostReplayer::IsTrackableActor(const AActor* Actor) const
+{
+	for (const TSubclassOf<AActor>& TrackableClass : TrackableClasses)
+	{
+		if (TrackableClass && Actor->IsA(TrackableClass))
+		{
+			return true;
+		}
+	}
+
+	// Qualquer corpo com física também pode virar ghost
+	const UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Actor->GetRootComponent());
+	return bTrackPhysicsBodies && Primitive && Primitive->IsSimulatingPhysics();
+}
+
 void AGhostReplayer::RestartActorPosition(AActor* Actor)
 {
 	if (TrackedActors.Contains(Actor))
 	{
-		Actor->SetActorTransform(TrackedActors[Actor]);
+		Actor->SetActorTransform(TrackedActors[Actor], false, nullptr, ETeleportType::ResetPhysics);
+		if (UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Actor->GetRootComponent()))
+		{
+			if (Primitive->IsSimulatingPhysics())
+			{
+				Primitive->SetPhysicsLinearVelocity(FVector::ZeroVector);
+				Primitive->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+			}
+		}
 		SpawnGhost(Actor);
 	}
 }
@@ -298,62 +717,206 @@ void AGhostReplayer::SpawnGhost(AActor* Actor)
 {
 	if (TrackedActors.Contains(Actor))
 	{
-		UWorld* World = GetWorld();
-		if (World)
+		if (UGhostComponent* GhostComponent = AcquireConfiguredGhost(Actor))
 		{
+			GhostComponent->SpawnTimer();
+			GhostComponent->StartCapture();
+		}
+	}
+}
+
+UGhostComponent* AGhostReplayer::AcquireConfiguredGhost(AActor* Actor)
+{
+	AActor* Ghost = AcquireGhost(Actor);
+	if (!Ghost)
+	{
+		return nullptr;
+	}
+
+	UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost);
+	if (!GhostComponent)
+	{
+		GhostRegistry.Remove(Ghost);
+		Ghost->Destroy();
+		return nullptr;
+	}
+
+	GhostComponent->captureInterval = captureInterval;
+	GhostComponent->captureTime = captureTime;
+	GhostComponent->CaptureRate = CaptureRate;
+	GhostComponent->KeyframeReduction = KeyframeReduction;
+	GhostComponent->ReplayCount = DefaultReplayCount;
+	GhostComponent->ReplayCounter = 0;
+	GhostComponent->FollowTarget = Actor;
+	GhostComponent->CollisionResponses = CollisionResponses;
+	GhostComponent->TargetIconActorClass = TargetIconActorClass;
+	GhostComponent->ParentGhostReplayer = this;
+
+	GhostActors.FindOrAdd(Actor).Ghosts.Add(Ghost);
+	return GhostComponent;
+}
 
-			AActor* Ghost = World->SpawnActor<AActor>(Actor->GetClass(), Actor->GetActorTransform());
-			if (Ghost)
+void AGhostReplayer::SendCycle(AActor* Actor)
+{
+	// Standalone não tem para quem mandar; no listen server o host já tem os ghosts de verdade
+	if (GetNetMode() == NM_Standalone)
+	{
+		return;
+	}
+
+	// O ghost que acabou de capturar é o único que os clientes ainda não têm
+	const FGhostRecording* Recording = nullptr;
+	if (const FGhostsArray* GhostsArray = GhostActors.Find(Actor))
+	{
+		for (AActor* Ghost : GhostsArray->Ghosts)
+		{
+			const UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost);
+			if (GhostComponent && GhostComponent->bIsCapturing)
 			{
-				UGhostComponent* GhostComponent = NewObject<UGhostComponent>(Ghost);
-				if(GhostComponent)
-				{
-					GhostComponent->RegisterComponent();
-					Ghost->AddOwnedComponent(GhostComponent);
-
-					GhostComponent->captureInterval = captureInterval;
-					GhostComponent->captureTime = captureTime;
-					GhostComponent->ReplayCount = DefaultReplayCount;
-					GhostComponent->FollowTarget = Actor;
-					GhostComponent->CollisionResponses = CollisionResponses;
-					GhostComponent->TargetIconActorClass = TargetIconActorClass;
-					GhostComponent->ParentGhostReplayer = this;
-					GhostComponent->SpawnTimer();
-
-					if (GhostMaterial)
-					{
-						TArray<UMeshComponent*> MeshComps;
-						Ghost->GetComponents<UMeshComponent>(MeshComps);
-
-						for (UMeshComponent* MeshComp : MeshComps)
-						{
-							if (!MeshComp) continue;
-							const int32 NumMats = MeshComp->GetNumMaterials();
-							for (int32 i = 0; i < NumMats; i++)
-							{
-								MeshComp->SetMaterial(i, GhostMaterial);
-							}
-						}
-					}
-
-					if(GhostActors.Contains(Actor))
-					{
-						GhostActors[Actor].Ghosts.Add(Ghost);
-					} else {
-						FGhostsArray GhostsArray;
-						GhostsArray.Ghosts.Add(Ghost);
-						GhostActors.Add(Actor, GhostsArray);
-					}
-					
-				} else
-				{
-					Ghost->Destroy();
-				}
+				Recording = GhostComponent->GetRecording();
+			}
+		}
+	}
+
+	TArray<uint8> Bytes;
+	if (Recording)
+	{
+		FGhostReplayFile::CompressRecording(*Recording, Bytes);
+	}
+
+	// NumParts é uint8, passar disso chegaria truncado nos clientes. Manda só o início do ciclo
+	const int32 NumParts = FMath::DivideAndRoundUp(Bytes.Num(), MaxBytesPerChunk);
+	if (NumParts > MAX_uint8)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s: recording of %s is %d bytes compressed, over the %d that fit in %d chunks, not sent to clients"),
+			*GetName(), *GetNameSafe(Actor), Bytes.Num(), MAX_uint8 * MaxBytesPerChunk, MAX_uint8);
+		Recording = nullptr;
+		Bytes.Reset();
+	}
+
+	FGhostNetChunk Chunk;
+	Chunk.TrackedActor = Actor;
+	Chunk.ServerTime = GetServerTime();
+	Chunk.NumParts = (uint8)FMath::DivideAndRoundUp(Bytes.Num(), MaxBytesPerChunk);
+
+	const UNetDriver* NetDriver = GetNetDriver();
+	const int32 NumConnections = NetDriver ? NetDriver->ClientConnections.Num() : 0;
+
+	if (Chunk.NumParts == 0)
+	{
+		// Sem gravação nova, só avisa o início do ciclo
+		MulticastGhostCycle(Chunk);
+		NetStats.RPCs += NumConnections;
+	}
+	for (int32 Part = 0; Part < Chunk.NumParts; Part++)
+	{
+		const int32 Offset = Part * MaxBytesPerChunk;
+		Chunk.Part = Part;
+		Chunk.Bytes.Reset();
+		Chunk.Bytes.Append(Bytes.GetData() + Offset, FMath::Min(MaxBytesPerChunk, Bytes.Num() - Offset));
+		MulticastGhostCycle(Chunk);
+		NetStats.RPCs += NumConnections;
+	}
+
+	NetStats.Cycles++;
+	if (Recording && Bytes.Num() > 0)
+	{
+		const float Duration = Recording->GetEndTime() - Recording->GetStartTime();
+		NetStats.RecordingsSent++;
+		NetStats.RawBytes += (int64)Recording->Num() * FGhostReplayFile::GetFrameSize(FGhostReplayFile::Version);
+		NetStats.PayloadBytes += Bytes.Num();
+		NetStats.BytesSent += (int64)Bytes.Num() * NumConnections;
+		// O que custaria replicar o ghost como ator: cada replay manda CaptureRate updates por segundo
+		NetStats.PerFrameEstimateBytes += (int64)(Duration * CaptureRate * DefaultReplayCount * PerFrameUpdateBytes) * NumConnections;
+	}
+}
+
+void AGhostReplayer::MulticastGhostCycle_Implementation(const FGhostNetChunk& Chunk)
+{
+	if (HasAuthority() || !Chunk.TrackedActor)
+	{
+		return;
+	}
+
+	// RPC reliable chega em ordem, as partes só precisam ser concatenadas
+	TArray<uint8>& Pending = PendingRecordings.FindOrAdd(Chunk.TrackedActor);
+	if (Chunk.Part == 0)
+	{
+		Pending.Reset();
+	}
+	Pending.Append(Chunk.Bytes);
+	if (Chunk.Part + 1 < Chunk.NumParts)
+	{
+		return;
+	}
+
+	TArray<uint8> Bytes = MoveTemp(Pending);
+	PendingRecordings.Remove(Chunk.TrackedActor);
+	StartClientCycle(Chunk.TrackedActor, Bytes, Chunk.ServerTime);
+}
+
+void AGhostReplayer::StartClientCycle(AActor* Actor, TArrayView<const uint8> Bytes, double ServerTime)
+{
+	if (Bytes.Num() > 0)
+	{
+		UGhostComponent* GhostComponent = AcquireConfiguredGhost(Actor);
+		if (GhostComponent && !GhostComponent->LoadRecording(Bytes))
+		{
+			ReleaseGhost(GhostComponent->GetOwner());
+		}
+	}
+
+	// Mesmo ponto do replay que o servidor, descontando a latência
+	const float StartOffset = (float)FMath::Max(GetServerTime() - ServerTime, 0.0);
+
+	if (const FGhostsArray* GhostsArray = GhostActors.Find(Actor))
+	{
+		TArray<AActor*> Ghosts = GhostsArray->Ghosts;
+		for (AActor* Ghost : Ghosts)
+		{
+			if (UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost))
+			{
+				GhostComponent->StartReplay(StartOffset);
 			}
 		}
 	}
 }
 
+void AGhostReplayer::OnRep_TrackedActors(const TArray<AActor*>& PreviousTrackedActors)
+{
+	for (AActor* Actor : PreviousTrackedActors)
+	{
+		if (Actor && !ReplicatedTrackedActors.Contains(Actor))
+		{
+			SetTrackedPostProcess(Actor, false);
+			DestroyGhostsForActor(Actor);
+			PendingRecordings.Remove(Actor);
+		}
+	}
+
+	for (AActor* Actor : ReplicatedTrackedActors)
+	{
+		if (Actor && !PreviousTrackedActors.Contains(Actor))
+		{
+			SetTrackedPostProcess(Actor, true);
+		}
+	}
+}
+
+double AGhostReplayer::GetServerTime() const
+{
+	const UWorld* World = GetWorld();
+	const AGameStateBase* GameState = World ? World->GetGameState() : nullptr;
+	return GameState ? GameState->GetServerWorldTimeSeconds() : (World ? World->GetTimeSeconds() : 0.0);
+}
+
+void AGhostReplayer::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AGhostReplayer, ReplicatedTrackedActors);
+}
+
 
 void AGhostReplayer::DestroyGhostsForActor(AActor* Actor)
 {
@@ -364,9 +927,9 @@ void AGhostReplayer::DestroyGhostsForActor(AActor* Actor)
 		//FActorData& Data = TrackedActors[Actor];
 		for (AActor* Ghost : Ghosts)
 		{
-			if (Ghost)
+			if (IsValid(Ghost))
 			{
-				Ghost->Destroy();
+				ReleaseGhost(Ghost);
 			}
 		}
 		GhostActors[Actor].Ghosts.Empty();
@@ -375,19 +938,141 @@ void AGhostReplayer::DestroyGhostsForActor(AActor* Actor)
 }
 
 
-bool AGhostReplayer::IsGhostActor(AActor* Actor) const
+int64 AGhostReplayer::GetRecordingMemoryBytes() const
 {
-	if(!Actor)
+	int64 Bytes = 0;
+	for (const auto& Pair : GhostRegistry)
 	{
+		if (!Pair.Value)
+		{
+			continue;
+		}
+
+		if (const FGhostRecording* Recording = Pair.Value->GetRecording())
+		{
+			Bytes += Recording->GetAllocatedSize();
+		}
+	}
+	return Bytes;
+}
+
+FGhostKeyframeStats AGhostReplayer::GetKeyframeStats() const
+{
+	FGhostKeyframeStats Stats;
+	for (const auto& Pair : GhostRegistry)
+	{
+		if (!Pair.Value)
+		{
+			continue;
+		}
+
+		if (const FGhostRecording* Recording = Pair.Value->GetRecording())
+		{
+			Stats.Accumulate(Recording->GetKeyframeStats());
+		}
+	}
+	return Stats;
+}
+
+bool AGhostReplayer::SaveReplay(const FString& FileName) const
+{
+	TArray<const FGhostRecording*> Recordings;
+	for (const auto& Pair : GhostActors)
+	{
+		for (AActor* Ghost : Pair.Value.Ghosts)
+		{
+			const UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost);
+			// Ghost ainda capturando tem gravação incompleta
+			if (!GhostComponent || GhostComponent->bIsCapturing)
+			{
+				continue;
+			}
+
+			const FGhostRecording* Recording = GhostComponent->GetRecording();
+			if (Recording && !Recording->IsEmpty())
+			{
+				Recordings.Add(Recording);
+			}
+		}
+	}
+
+	if (Recordings.Num() == 0)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s: no finished recording to save"), *GetName());
 		return false;
 	}
 
-	UGhostComponent* GhostComponent = Actor->FindComponentByClass<UGhostComponent>();
-	if (GhostComponent)
+	return FGhostReplayFile::Save(FGhostReplayFile::ResolvePath(FileName), Recordings);
+}
+
+bool AGhostReplayer::LoadReplay(const FString& FileName, ACharacter* MeshSource, bool bLoop)
+{
+	TSharedPtr<FGhostReplayFile> File = FGhostReplayFile::Open(FGhostReplayFile::ResolvePath(FileName));
+	if (!File)
+	{
+		return false;
+	}
+
+	if (!MeshSource)
 	{
-		return true;
+		MeshSource = UGameplayStatics::GetPlayerCharacter(this, 0);
 	}
-	return false;
+	if (!MeshSource)
+	{
+		UE_LOG(LogGhost, Warning, TEXT("%s: no character to take the ghost mesh from"), *GetName());
+		return false;
+	}
+
+	ClearLoadedReplay();
+
+	for (int32 StreamIndex = 0; StreamIndex < File->NumStreams(); StreamIndex++)
+	{
+		AActor* Ghost = AcquireGhost(MeshSource);
+		UGhostComponent* GhostComponent = GhostRegistry.FindRef(Ghost);
+		if (!GhostComponent)
+		{
+			continue;
+		}
+
+		GhostComponent->FollowTarget = nullptr;
+		GhostComponent->ReplayCounter = 0;
+		GhostComponent->CollisionResponses = CollisionResponses;
+		GhostComponent->ParentGhostReplayer = this;
+		GhostComponent->StartStreamedReplay(File.ToSharedRef(), StreamIndex, bLoop);
+		LoadedGhosts.Add(Ghost);
+	}
+
+	return LoadedGhosts.Num() > 0;
+}
+
+void AGhostReplayer::ClearLoadedReplay()
+{
+	TArray<AActor*> Ghosts = MoveTemp(LoadedGhosts);
+	LoadedGhosts.Reset();
+	for (AActor* Ghost : Ghosts)
+	{
+		if (IsValid(Ghost))
+		{
+			ReleaseGhost(Ghost);
+		}
+	}
+}
+
+int32 AGhostReplayer::GetGhostCount(AActor* TrackedActor) const
+{
+	const FGhostsArray* GhostsArray = GhostActors.Find(TrackedActor);
+	return GhostsArray ? GhostsArray->Ghosts.Num() : 0;
+}
+
+bool AGhostReplayer::IsGhostActor(AActor* Actor) const
+{
+	if(!Actor)
+	{
+		return false;
+	}
+
+	// Proxies de qualquer replayer são ghosts; clones estão no registro (e marcados como Untrackable)
+	return Actor->IsA<AGhostProxy>() || GhostRegistry.Contains(Actor);
 }
 
 void AGhostReplayer::EndPlay(const EEndPlayReason::Type EndPlayReason)
@@ -400,4 +1085,49 @@ void AGhostReplayer::EndPlay(const EEndPlayReason::Type EndPlayReason)
 	}
 
 	ActorTimers.Empty();
+
+	TArray<AActor*> Candidates = OverlappingActors;
+	for (AActor* Candidate : Candidates)
+	{
+		RemoveCandidate(Candidate);
+	}
+
+	ClearLoadedReplay();
+
+	// Ghosts ainda vivos soltam o slot no UGhostPlaybackSubsystem antes do registro sumir,
+	// senão o subsystem continua capturando para um replayer que já acabou
+	TArray<AActor*> FollowedActors;
+	GhostActors.GetKeys(FollowedActors);
+	for (AActor* FollowedActor : FollowedActors)
+	{
+		DestroyGhostsForActor(FollowedActor);
+	}
+	GhostActors.Empty();
+
+	for (const auto& Pair : GhostRegistry)
+	{
+		if (IsValid(Pair.Value))
+		{
+			Pair.Value->StopGhost();
+		}
+	}
+
+	for (AGhostProxy* Proxy : GhostPool)
+	{
+		if (IsValid(Proxy))
+		{
+			Proxy->Destroy();
+		}
+	}
+	GhostPool.Empty();
+	GhostRegistry.Empty();
+
+	for (AActor* TimerIcon : TimerIconPool)
+	{
+		if (IsValid(TimerIcon))
+		{
+			TimerIcon->Destroy();
+		}
+	}
+	TimerIconPool.Empty();
 }
\ No newline at end of file
@@ -2,8 +2,13 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "GhostRecording.h"
 #include "GhostReplayer.generated.h"
 
+class ACharacter;
+class AGhostProxy;
+class UGhostComponent;
+
 USTRUCT(BlueprintType)
 struct FGhostsArray
 {
@@ -13,6 +18,63 @@ struct FGhostsArray
 	TArray<AActor*> Ghosts;
 };
 
+// Part of a compressed recording sent to clients at the start of a replay cycle.
+// NumParts 0 only starts the cycle, there was no new recording
+USTRUCT()
+struct FGhostNetChunk
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	AActor* TrackedActor = nullptr;
+
+	// Server time when the cycle started, clients skip the time the RPC took to arrive
+	UPROPERTY()
+	double ServerTime = 0.0;
+
+	UPROPERTY()
+	uint8 Part = 0;
+
+	UPROPERTY()
+	uint8 NumParts = 0;
+
+	UPROPERTY()
+	TArray<uint8> Bytes;
+};
+
+// Ghost traffic sent by the server since BeginPlay
+USTRUCT(BlueprintType)
+struct FGhostNetStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 Cycles = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 RecordingsSent = 0;
+
+	// RPCs summed over client connections
+	UPROPERTY(BlueprintReadOnly)
+	int32 RPCs = 0;
+
+	// Recordings before compression
+	UPROPERTY(BlueprintReadOnly)
+	int64 RawBytes = 0;
+
+	// Compressed recordings, once
+	UPROPERTY(BlueprintReadOnly)
+	int64 PayloadBytes = 0;
+
+	// Compressed recordings times client connections
+	UPROPERTY(BlueprintReadOnly)
+	int64 BytesSent = 0;
+
+	// Estimate of replicating every replaying ghost as an actor instead
+	UPROPERTY(BlueprintReadOnly)
+	int64 PerFrameEstimateBytes = 0;
+};
+
 UCLASS()
 class PUZZLE_API AGhostReplayer : public AActor
 {
@@ -43,9 +105,16 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float captureTime = 5.0f;
 
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="1.0"))
+	float CaptureRate = 20.0f;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	int DefaultReplayCount = 3;
 
+	// Tolerances for dropping captured frames, copied to every ghost
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FGhostKeyframeReduction KeyframeReduction;
+
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TMap<AActor*, FTransform> TrackedActors;
 
@@ -68,26 +137,138 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TSubclassOf<AActor> TargetIconActorClass;
 
+	// Spawned in place of a full clone when the tracked actor is a Character
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TSubclassOf<AGhostProxy> GhostProxyClass;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TMap<TEnumAsByte<ECollisionChannel>, TEnumAsByte<ECollisionResponse>> CollisionResponses;
 
+	// Actors of these classes are ghosted when they enter the volume
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ghost Replayer")
+	TArray<TSubclassOf<AActor>> TrackableClasses;
+
+	// Also ghost any actor whose root simulates physics, whatever its class
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ghost Replayer")
+	bool bTrackPhysicsBodies = true;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ghost Replayer")
 	bool bIsEnabled = true;
 
 	UFUNCTION(BlueprintCallable, Category = "Ghost Replayer", CallInEditor)
 	void SetEnabled(bool bEnabled);
+
+	// Tracked actors the ghost and timer pools are sized for at BeginPlay.
+	// Each one needs DefaultReplayCount + 1 ghosts alive at once
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ghost Replayer", meta=(ClampMin="0"))
+	int PoolPrewarmActors = 1;
+
+	// Puts a ghost back in the pool, or destroys it when it cannot be reused
+	void ReleaseGhost(AActor* Ghost);
+
+	AActor* AcquireTimerIcon(const FVector& Location, const FRotator& Rotation);
+	void ReleaseTimerIcon(AActor* TimerIcon);
+
+	// Live ghosts (capturing or replaying) of TrackedActor
+	UFUNCTION(BlueprintPure, Category = "Ghost Replayer")
+	int32 GetGhostCount(AActor* TrackedActor) const;
+
+	// Bandwidth used to send recordings to clients, see Ghost.NetReport
+	UFUNCTION(BlueprintPure, Category = "Ghost Replayer")
+	FGhostNetStats GetNetStats() const { return NetStats; }
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	// Bytes held by the recordings of every ghost owned by this replayer
+	UFUNCTION(BlueprintPure, Category = "Ghost Replayer")
+	int64 GetRecordingMemoryBytes() const;
+
+	// Keyframe reduction of every live recording: compression ratio and worst reconstruction error
+	UFUNCTION(BlueprintPure, Category = "Ghost Replayer")
+	FGhostKeyframeStats GetKeyframeStats() const;
+
+	// Writes the finished recordings of every live ghost to a .ghost file.
+	// Relative names go to Saved/Ghosts
+	UFUNCTION(BlueprintCallable, Category = "Ghost Replayer")
+	bool SaveReplay(const FString& FileName) const;
+
+	// Replays every ghost stored in FileName, streaming its frames from disk.
+	// MeshSource gives the ghosts their mesh, player 0's character when not set
+	UFUNCTION(BlueprintCallable, Category = "Ghost Replayer")
+	bool LoadReplay(const FString& FileName, ACharacter* MeshSource = nullptr, bool bLoop = true);
+
+	UFUNCTION(BlueprintCallable, Category = "Ghost Replayer")
+	void ClearLoadedReplay();
 	
 
 private:	
 	
 	void NotifyActorEndOverlap(AActor* OtherActor);
+	void StartTrackingActor(AActor* Actor);
 	void StopTrackingActor(AActor* Actor);
+
+	// Containment: candidates are only re-evaluated after their root component moves
+	void AddCandidate(AActor* Actor);
+	void RemoveCandidate(AActor* Actor);
+	void OnCandidateMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+	bool IsFullyInside(const AActor* Actor) const;
+
+	TMap<TWeakObjectPtr<AActor>, FDelegateHandle> CandidateMoveHandles;
+	TSet<TWeakObjectPtr<AActor>> DirtyCandidates;
 	void StartReplay(AActor* Actor);
 	void RestartActorPosition(AActor* Actor);
 
 	void SpawnGhost(AActor* Actor);
+	UGhostComponent* AcquireConfiguredGhost(AActor* Actor);
+	void SetTrackedPostProcess(AActor* Actor, bool bTracked) const;
+
+	// Networking: the server captures, clients get each new recording once per cycle
+	static constexpr int32 MaxBytesPerChunk = 8 * 1024;
+	// Rough size of one movement update of a replicated actor, for the estimate in FGhostNetStats
+	static constexpr int32 PerFrameUpdateBytes = 24;
+
+	void SendCycle(AActor* Actor);
+	void StartClientCycle(AActor* Actor, TArrayView<const uint8> Bytes, double ServerTime);
+	double GetServerTime() const;
+
+	UFUNCTION(NetMulticast, Reliable)
+	void MulticastGhostCycle(const FGhostNetChunk& Chunk);
+
+	UFUNCTION()
+	void OnRep_TrackedActors(const TArray<AActor*>& PreviousTrackedActors);
+
+	// Keys of TrackedActors, replicated so clients can clean up and apply the post process
+	UPROPERTY(ReplicatedUsing = OnRep_TrackedActors)
+	TArray<AActor*> ReplicatedTrackedActors;
+
+	// Parts of a recording still arriving, per tracked actor
+	TMap<TWeakObjectPtr<AActor>, TArray<uint8>> PendingRecordings;
+
+	FGhostNetStats NetStats;
 	void DestroyGhostsForActor(AActor* Actor);
 
+	void PrewarmPools();
+	AActor* AcquireGhost(AActor* Actor);
+	AGhostProxy* PopPooledProxy();
+	bool IsTrackableActor(const AActor* Actor) const;
+	AGhostProxy* SpawnPooledProxy();
+	void ApplyGhostMaterial(AActor* Ghost) const;
+
+	// Every ghost this replayer ever created, pooled or live, with its component
+	UPROPERTY(Transient)
+	TMap<AActor*, UGhostComponent*> GhostRegistry;
+
+	// Hidden proxies waiting for the next SpawnGhost
+	UPROPERTY(Transient)
+	TArray<AGhostProxy*> GhostPool;
+
+	UPROPERTY(Transient)
+	TArray<AActor*> TimerIconPool;
+
+	// Ghosts replaying a file from LoadReplay, they have no FollowTarget
+	UPROPERTY(Transient)
+	TArray<AActor*> LoadedGhosts;
+
 	bool IsGhostActor(AActor* Actor) const;
 	virtual void EndPlay(EEndPlayReason::Type EndPlayReason) override;
 };
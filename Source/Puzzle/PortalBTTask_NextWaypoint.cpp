@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalBTTask_NextWaypoint.h"
+
+#include "AIController.h"
+#include "PortalGraphSubsystem.h"
+#include "TeleportPortal.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+
+UPortalBTTask_NextWaypoint::UPortalBTTask_NextWaypoint()
+{
+	NodeName = "Next Portal Waypoint";
+
+	BlackboardKey.AddVectorFilter(this, GET_MEMBER_NAME_CHECKED(UPortalBTTask_NextWaypoint, BlackboardKey));
+	BlackboardKey.AddObjectFilter(this, GET_MEMBER_NAME_CHECKED(UPortalBTTask_NextWaypoint, BlackboardKey), AActor::StaticClass());
+	WaypointKey.AddVectorFilter(this, GET_MEMBER_NAME_CHECKED(UPortalBTTask_NextWaypoint, WaypointKey));
+}
+
+void UPortalBTTask_NextWaypoint::InitializeFromAsset(UBehaviorTree& Asset)
+{
+	Super::InitializeFromAsset(Asset);
+
+	if (const UBlackboardData* BlackboardAsset = GetBlackboardAsset())
+	{
+		WaypointKey.ResolveSelectedKey(*BlackboardAsset);
+	}
+}
+
+EBTNodeResult::Type UPortalBTTask_NextWaypoint::ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	const UPortalGraphSubsystem* Graph = GetWorld()->GetSubsystem<UPortalGraphSubsystem>();
+	APawn* Pawn = OwnerComp.GetAIOwner()->GetPawn();
+	UBlackboardComponent* Blackboard = OwnerComp.GetBlackboardComponent();
+	if (!Graph || !Pawn || !Blackboard)
+	{
+		return EBTNodeResult::Failed;
+	}
+
+	FVector Destination;
+	if (BlackboardKey.SelectedKeyType == UBlackboardKeyType_Object::StaticClass())
+	{
+		const AActor* Target = Cast<AActor>(Blackboard->GetValueAsObject(BlackboardKey.SelectedKeyName));
+		if (!Target)
+		{
+			return EBTNodeResult::Failed;
+		}
+		Destination = Target->GetActorLocation();
+	}
+	else
+	{
+		Destination = Blackboard->GetValueAsVector(BlackboardKey.SelectedKeyName);
+	}
+
+	FVector Waypoint;
+	ATeleportPortal* Portal;
+	if (!Graph->GetNextWaypoint(Pawn->GetActorLocation(), Destination, Waypoint, Portal))
+	{
+		return EBTNodeResult::Failed;
+	}
+
+	// Já na frente do portal: passa e segue do outro lado
+	if (Portal && FVector::Dist(Pawn->GetNavAgentLocation(), Waypoint) <= TeleportRadius && Portal->TeleportFromNavPoint(Pawn)
+		&& !Graph->GetNextWaypoint(Pawn->GetActorLocation(), Destination, Waypoint, Portal))
+	{
+		return EBTNodeResult::Failed;
+	}
+
+	Blackboard->SetValueAsVector(WaypointKey.SelectedKeyName, Waypoint);
+	return EBTNodeResult::Succeeded;
+}
+
+FString UPortalBTTask_NextWaypoint::GetStaticDescription() const
+{
+	return FString::Printf(TEXT("Next Portal Waypoint\nTo: %s\nWaypoint: %s"), *BlackboardKey.SelectedKeyName.ToString(),
+		*WaypointKey.SelectedKeyName.ToString());
+}
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/Tasks/BTTask_BlackboardBase.h"
+#include "PortalBTTask_NextWaypoint.generated.h"
+
+/**
+ * Looks up in UPortalGraphSubsystem where the pawn walks next on its way to the Blackboard Key,
+ * a location or an actor, and writes it to Waypoint Key. Put a Move To on Waypoint Key after it
+ * and loop both: each step is an ordinary navmesh move to the front of the next portal, and the
+ * task sends the pawn through once it stands there.
+ */
+UCLASS(meta=(DisplayName = "Next Portal Waypoint"))
+class PUZZLE_API UPortalBTTask_NextWaypoint : public UBTTask_BlackboardBase
+{
+	GENERATED_BODY()
+
+public:
+	UPortalBTTask_NextWaypoint();
+
+	/** Where to walk next, the destination itself once no portal is left on the way. */
+	UPROPERTY(Category = Blackboard, EditAnywhere)
+	FBlackboardKeySelector WaypointKey;
+
+	/** How close to the front of the next portal the pawn goes through, keep it above the Move To's Acceptable Radius. */
+	UPROPERTY(Category = Node, EditAnywhere, meta=(ClampMin = "0.0", UIMin = "0.0"))
+	float TeleportRadius = 100.0f;
+
+	virtual void InitializeFromAsset(UBehaviorTree& Asset) override;
+	virtual EBTNodeResult::Type ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+	virtual FString GetStaticDescription() const override;
+};
@@ -0,0 +1,467 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalGraphSubsystem.h"
+
+#include "NavigationData.h"
+#include "NavigationSystem.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "TeleportPortal.h"
+#include "Engine/LevelStreaming.h"
+#include "Engine/World.h"
+#include "WorldPartition/WorldPartitionSubsystem.h"
+
+DEFINE_STAT(STAT_PortalGraphBuild);
+DEFINE_STAT(STAT_PortalPrefetchSources);
+
+void UPortalGraphSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	if (UWorldPartitionSubsystem* WorldPartition = InWorld.GetSubsystem<UWorldPartitionSubsystem>())
+	{
+		WorldPartition->RegisterStreamingSourceProvider(this);
+	}
+
+	if (UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(&InWorld))
+	{
+		NavSys->OnNavigationGenerationFinishedDelegate.AddDynamic(this, &UPortalGraphSubsystem::OnNavigationGenerationFinished);
+	}
+}
+
+void UPortalGraphSubsystem::Deinitialize()
+{
+	if (UWorld* World = GetWorld())
+	{
+		if (UWorldPartitionSubsystem* WorldPartition = World->GetSubsystem<UWorldPartitionSubsystem>())
+		{
+			WorldPartition->UnregisterStreamingSourceProvider(this);
+		}
+		if (UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(World))
+		{
+			NavSys->OnNavigationGenerationFinishedDelegate.RemoveAll(this);
+		}
+	}
+
+	Super::Deinitialize();
+}
+
+TStatId UPortalGraphSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPortalGraphSubsystem, STATGROUP_Tickables);
+}
+
+void UPortalGraphSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Os portais do nível registram no BeginPlay, o primeiro tick já vê todos
+	const UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (bNavigationChanged || (Portals && Portals->GetTopologyVersion() != BuiltTopologyVersion))
+	{
+		Rebuild();
+	}
+
+	UpdatePrefetchPortals();
+	UpdateLevelStreaming();
+}
+
+void UPortalGraphSubsystem::OnNavigationGenerationFinished(ANavigationData* InNavData)
+{
+	bNavigationChanged = true;
+}
+
+void UPortalGraphSubsystem::Rebuild()
+{
+	SCOPE_CYCLE_COUNTER(STAT_PortalGraphBuild);
+
+	UWorld* World = GetWorld();
+	const UPortalSubsystem* Portals = World->GetSubsystem<UPortalSubsystem>();
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(World);
+	BuiltTopologyVersion = Portals ? Portals->GetTopologyVersion() : 0;
+	bNavigationChanged = false;
+
+	Nodes.Reset();
+	PolyRegions.Reset();
+	NumRegions = 0;
+	if (Portals)
+	{
+		Nodes.Append(Portals->GetPortals().GetData(), Portals->GetPortals().Num());
+	}
+
+	const int32 NumSlots = Nodes.Num();
+	NavPoints.Init(FVector::ZeroVector, NumSlots);
+	NodeRegions.Init(INDEX_NONE, NumSlots);
+	ExitSlots.Init(INDEX_NONE, NumSlots);
+	SourceNames.Init(NAME_None, NumSlots);
+	ExitLevels.Init(nullptr, NumSlots);
+
+	for (auto It = KnownExitLevels.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	const ARecastNavMesh* NavMesh = Cast<ARecastNavMesh>(NavSys ? NavSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate) : nullptr);
+	NavData = NavMesh;
+
+	for (int32 Slot = 0; Slot < NumSlots; ++Slot)
+	{
+		const ATeleportPortal* Portal = Nodes[Slot].Get();
+		if (!Portal)
+		{
+			continue;
+		}
+
+		SourceNames[Slot] = FName(*FString::Printf(TEXT("PortalPrefetch_%s"), *Portal->GetName()));
+
+		const ATeleportPortal* Exit = Portal->LinkedPortal;
+		if (Portal->bIsActivated && Exit && Nodes.IsValidIndex(Exit->GetPortalSlot()) && Nodes[Exit->GetPortalSlot()].Get() == Exit)
+		{
+			ExitSlots[Slot] = Exit->GetPortalSlot();
+			KnownExitLevels.Add(Portal, FindStreamingLevel(Exit));
+		}
+
+		// Com a saída descarregada fica o sublevel de quando ela estava lá
+		const TWeakObjectPtr<ULevelStreaming>* ExitLevel = KnownExitLevels.Find(Portal);
+		if (Portal->bIsActivated && ExitLevel)
+		{
+			ExitLevels[Slot] = *ExitLevel;
+		}
+
+		FVector Point;
+		FNavLocation Projected;
+		if (!NavMesh || !Portal->GetNavPoint(Point) || !NavSys->ProjectPointToNavigation(Point, Projected, FVector(NavProjectionExtent), NavMesh))
+		{
+			continue;
+		}
+		NavPoints[Slot] = Projected.Location;
+
+		// Polígono já marcado entra na região dele, senão abre uma nova com tudo que dá para andar dali
+		const int32* Region = PolyRegions.Find(Projected.NodeRef);
+		NodeRegions[Slot] = Region ? *Region : AddRegion(*NavMesh, Projected.NodeRef);
+	}
+
+	// Arestas de cada região, uma por portal que leva a outra região
+	TArray<TArray<int32>> RegionEdges;
+	RegionEdges.SetNum(NumRegions);
+	int32 NumEdges = 0;
+	for (int32 Slot = 0; Slot < NumSlots; ++Slot)
+	{
+		const int32 Exit = ExitSlots[Slot];
+		if (Exit != INDEX_NONE && NodeRegions[Slot] != INDEX_NONE && NodeRegions[Exit] != INDEX_NONE && NodeRegions[Slot] != NodeRegions[Exit])
+		{
+			RegionEdges[NodeRegions[Slot]].Add(Slot);
+			++NumEdges;
+		}
+	}
+
+	// Uma busca em largura por região de origem, com poucos portais é barato e só roda aqui
+	NextPortals.Init(INDEX_NONE, NumRegions * NumRegions);
+	HopCounts.Init(NoPath, NumRegions * NumRegions);
+	TArray<int32> Queue;
+	Queue.Reserve(NumRegions);
+	for (int32 Source = 0; Source < NumRegions; ++Source)
+	{
+		int32* Next = &NextPortals[Source * NumRegions];
+		uint8* Hops = &HopCounts[Source * NumRegions];
+		Hops[Source] = 0;
+
+		Queue.Reset();
+		Queue.Add(Source);
+		for (int32 Head = 0; Head < Queue.Num(); ++Head)
+		{
+			const int32 Region = Queue[Head];
+			if (Hops[Region] >= NoPath - 1)
+			{
+				continue;
+			}
+
+			for (const int32 Slot : RegionEdges[Region])
+			{
+				const int32 To = NodeRegions[ExitSlots[Slot]];
+				if (Hops[To] != NoPath)
+				{
+					continue;
+				}
+
+				// Saindo da origem o primeiro portal é este, depois é o mesmo de quem chegou antes
+				Hops[To] = Hops[Region] + 1;
+				Next[To] = Region == Source ? Slot : Next[Region];
+				Queue.Add(To);
+			}
+		}
+	}
+
+	UE_LOG(LogPortal, Log, TEXT("Portal graph: %d portals in %d regions, %d links between regions, %d navmesh polygons"), NumSlots, NumRegions, NumEdges, PolyRegions.Num());
+}
+
+int32 UPortalGraphSubsystem::AddRegion(const ARecastNavMesh& NavMesh, NavNodeRef StartPoly)
+{
+	const int32 Region = NumRegions++;
+	PolyRegions.Add(StartPoly, Region);
+
+	TArray<NavNodeRef> Pending;
+	TArray<NavNodeRef> Neighbors;
+	Pending.Add(StartPoly);
+	while (Pending.Num() > 0)
+	{
+		const NavNodeRef Poly = Pending.Pop(EAllowShrinking::No);
+		Neighbors.Reset();
+		NavMesh.GetPolyNeighbors(Poly, Neighbors);
+		for (const NavNodeRef Neighbor : Neighbors)
+		{
+			if (PolyRegions.Contains(Neighbor))
+			{
+				continue;
+			}
+			PolyRegions.Add(Neighbor, Region);
+			Pending.Add(Neighbor);
+		}
+	}
+	return Region;
+}
+
+int32 UPortalGraphSubsystem::FindRegion(const FVector& Location) const
+{
+	const UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	const ANavigationData* Data = NavData.Get();
+	FNavLocation Projected;
+	if (PolyRegions.Num() == 0 || !NavSys || !Data ||
+		!NavSys->ProjectPointToNavigation(Location, Projected, FVector(NavProjectionExtent), Data))
+	{
+		return INDEX_NONE;
+	}
+
+	const int32* Region = PolyRegions.Find(Projected.NodeRef);
+	return Region ? *Region : INDEX_NONE;
+}
+
+int32 UPortalGraphSubsystem::GetPortalRegion(const ATeleportPortal* Portal) const
+{
+	const int32 Slot = Portal ? Portal->GetPortalSlot() : INDEX_NONE;
+	return NodeRegions.IsValidIndex(Slot) && Nodes[Slot].Get() == Portal ? NodeRegions[Slot] : INDEX_NONE;
+}
+
+int32 UPortalGraphSubsystem::GetHopCount(int32 From, int32 To) const
+{
+	if (From < 0 || From >= NumRegions || To < 0 || To >= NumRegions)
+	{
+		return INDEX_NONE;
+	}
+
+	const uint8 Hops = HopCounts[From * NumRegions + To];
+	return Hops == NoPath ? INDEX_NONE : Hops;
+}
+
+ATeleportPortal* UPortalGraphSubsystem::GetNextPortal(int32 From, int32 To) const
+{
+	if (From < 0 || From >= NumRegions || To < 0 || To >= NumRegions)
+	{
+		return nullptr;
+	}
+
+	const int32 Slot = NextPortals[From * NumRegions + To];
+	return Slot != INDEX_NONE ? Nodes[Slot].Get() : nullptr;
+}
+
+bool UPortalGraphSubsystem::GetNextWaypoint(const FVector& From, const FVector& To, FVector& OutWaypoint, ATeleportPortal*& OutPortal) const
+{
+	OutWaypoint = To;
+	OutPortal = nullptr;
+
+	const int32 FromRegion = FindRegion(From);
+	const int32 ToRegion = FindRegion(To);
+	if (FromRegion == ToRegion)
+	{
+		// Mesma região, ou nenhum dos dois chega a um portal: só andando
+		return true;
+	}
+	if (FromRegion == INDEX_NONE || ToRegion == INDEX_NONE)
+	{
+		return false;
+	}
+
+	const int32 Slot = NextPortals[FromRegion * NumRegions + ToRegion];
+	OutPortal = Slot != INDEX_NONE ? Nodes[Slot].Get() : nullptr;
+	if (!OutPortal)
+	{
+		return false;
+	}
+
+	// A frente da entrada, o teleporte fica com quem chegar lá. Um link até a saída só funciona
+	// com ela perto, e a saída pode nem ter navmesh carregado
+	OutWaypoint = NavPoints[Slot];
+	return true;
+}
+
+void UPortalGraphSubsystem::UpdatePrefetchPortals()
+{
+	SeenPortals.Reset();
+	PrefetchPortals.Reset();
+
+	const UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (!Portals)
+	{
+		return;
+	}
+
+	// O que aparece pelo portal tem que estar visível já. Lê o que o último passe dos portais respondeu,
+	// o streaming roda antes da câmera deste frame
+	TArray<int32, TInlineAllocator<8>> SeenRegions;
+	for (int32 Slot = 0; Slot < Nodes.Num(); ++Slot)
+	{
+		if (!Nodes[Slot].IsValid() || !Portals->WasPortalVisible(Slot))
+		{
+			continue;
+		}
+
+		SeenPortals.Add(Slot);
+		const int32 Exit = ExitSlots[Slot];
+		if (Exit != INDEX_NONE && NodeRegions[Exit] != INDEX_NONE)
+		{
+			SeenRegions.AddUnique(NodeRegions[Exit]);
+		}
+	}
+
+	// Saídas a poucos portais dali só carregam, para não travar quando o jogador chegar nelas
+	for (int32 Slot = 0; Slot < Nodes.Num() && PrefetchHops > 0; ++Slot)
+	{
+		if (NodeRegions[Slot] == INDEX_NONE || SeenPortals.Contains(Slot))
+		{
+			continue;
+		}
+
+		// Atravessar este portal custa os saltos até a região dele e mais um
+		for (const int32 Region : SeenRegions)
+		{
+			if (HopCounts[Region * NumRegions + NodeRegions[Slot]] < PrefetchHops)
+			{
+				PrefetchPortals.Add(Slot);
+				break;
+			}
+		}
+	}
+}
+
+void UPortalGraphSubsystem::UpdateLevelStreaming()
+{
+	// Os sublevels de um mundo com World Partition são as células dele, quem cuida é GetStreamingSources
+	UWorld* World = GetWorld();
+	if (World->IsPartitionedWorld())
+	{
+		return;
+	}
+
+	TArray<ULevelStreaming*, TInlineAllocator<8>> Wanted;
+	for (const int32 Slot : SeenPortals)
+	{
+		if (ULevelStreaming* Level = ExitLevels[Slot].Get())
+		{
+			Level->SetShouldBeLoaded(true);
+			Level->SetShouldBeVisible(true);
+			Wanted.AddUnique(Level);
+
+			// Visível com o jogador podendo passar para lá, quem esconde de novo é o jogo
+			PrefetchedLevels.Remove(Level);
+		}
+	}
+
+	for (const int32 Slot : PrefetchPortals)
+	{
+		ULevelStreaming* Level = ExitLevels[Slot].Get();
+		if (!Level || Wanted.Contains(Level))
+		{
+			continue;
+		}
+
+		if (!Level->ShouldBeLoaded())
+		{
+			Level->SetShouldBeLoaded(true);
+			PrefetchedLevels.AddUnique(Level);
+		}
+		Wanted.Add(Level);
+	}
+
+	// Descarrega só o que carregou por conta própria e o jogo não mostrou nesse meio tempo
+	for (int32 Index = PrefetchedLevels.Num() - 1; Index >= 0; --Index)
+	{
+		ULevelStreaming* Level = PrefetchedLevels[Index].Get();
+		if (Level && Wanted.Contains(Level))
+		{
+			continue;
+		}
+
+		if (Level && !Level->GetShouldBeVisibleFlag())
+		{
+			Level->SetShouldBeLoaded(false);
+		}
+		PrefetchedLevels.RemoveAtSwap(Index);
+	}
+}
+
+ULevelStreaming* UPortalGraphSubsystem::FindStreamingLevel(const ATeleportPortal* Portal) const
+{
+	const ULevel* Level = Portal->GetLevel();
+	if (!Level || Level->IsPersistentLevel())
+	{
+		return nullptr;
+	}
+
+	for (ULevelStreaming* StreamingLevel : GetWorld()->GetStreamingLevels())
+	{
+		if (StreamingLevel && StreamingLevel->GetLoadedLevel() == Level)
+		{
+			return StreamingLevel;
+		}
+	}
+	return nullptr;
+}
+
+bool UPortalGraphSubsystem::GetStreamingSources(TArray<FWorldPartitionStreamingSource>& OutStreamingSources) const
+{
+	const int32 FirstSource = OutStreamingSources.Num();
+	TBitArray<> Added(false, Nodes.Num());
+
+	// Mesmas saídas que UpdateLevelStreaming, vistas ficam ativas e as de perto só carregam
+	for (const int32 Slot : SeenPortals)
+	{
+		const int32 Exit = ExitSlots[Slot];
+		if (Exit != INDEX_NONE && !Added[Exit])
+		{
+			Added[Exit] = true;
+			AddStreamingSource(OutStreamingSources, Exit, EStreamingSourceTargetState::Activated, EStreamingSourcePriority::High);
+		}
+	}
+	for (const int32 Slot : PrefetchPortals)
+	{
+		const int32 Exit = ExitSlots[Slot];
+		if (Exit != INDEX_NONE && !Added[Exit])
+		{
+			Added[Exit] = true;
+			AddStreamingSource(OutStreamingSources, Exit, EStreamingSourceTargetState::Loaded, EStreamingSourcePriority::Low);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_PortalPrefetchSources, OutStreamingSources.Num() - FirstSource);
+	return OutStreamingSources.Num() > FirstSource;
+}
+
+void UPortalGraphSubsystem::AddStreamingSource(TArray<FWorldPartitionStreamingSource>& OutStreamingSources, int32 Slot, EStreamingSourceTargetState TargetState, EStreamingSourcePriority Priority) const
+{
+	const ATeleportPortal* Portal = Nodes[Slot].Get();
+	if (!Portal)
+	{
+		return;
+	}
+
+	FWorldPartitionStreamingSource& Source = OutStreamingSources.AddDefaulted_GetRef();
+	Source.Name = SourceNames[Slot];
+	Source.Location = Portal->GetActorLocation();
+	Source.Rotation = Portal->ForwardDirection->GetComponentRotation();
+	Source.TargetState = TargetState;
+	Source.Priority = Priority;
+	Source.bBlockOnSlowLoading = false;
+}
@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavFilters/NavigationQueryFilter.h"
+#include "PortalSubsystem.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldPartition/WorldPartitionStreamingSource.h"
+#include "PortalGraphSubsystem.generated.h"
+
+class ANavigationData;
+class ARecastNavMesh;
+class ATeleportPortal;
+class ULevelStreaming;
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Portal Graph Build"), STAT_PortalGraphBuild, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Prefetch Sources"), STAT_PortalPrefetchSources, STATGROUP_Portals, PUZZLE_API);
+
+/**
+ * Where the portals of the world lead, for AI and streaming. Portal fronts are grouped into
+ * regions, the parts of the navmesh they can walk to without going through a portal, and every
+ * active linked portal is an edge from its region to the region of its exit. Shortest hop paths
+ * between every pair of regions are worked out when the graph is built, a query only looks
+ * them up. Walking is taken to work both ways when grouping fronts into regions.
+ *
+ * Regions are flood filled over the polygons of the Recast navmesh, leaving the portal links
+ * out, and every polygon reached is labeled with its region. Finding the region of a location
+ * is a projection onto the navmesh and a map lookup, no path is tested after the build.
+ *
+ * Nodes use the slots of UPortalSubsystem. The graph is rebuilt on the first tick after the
+ * portals change: when the level loads, when sublevels or World Partition stream portals in or out, when
+ * one is relinked or turned on or off, and when the navmesh is rebuilt. Moving a portal does not
+ * rebuild it.
+ *
+ * Also streams in what the portals lead to: the sublevel of the exit of every portal a local
+ * player sees is loaded and made visible, and the sublevels of the exits up to PrefetchHops
+ * portals further are loaded ahead. A sublevel only loaded ahead is unloaded again once no exit
+ * needs it and the game has not shown it, the ones made visible are left to the game to hide.
+ * The sublevel of an exit is remembered after it streams out, so looking at the portal brings it
+ * back. In a World Partition world the same exits are streaming sources instead.
+ */
+UCLASS(Config=Game)
+class PUZZLE_API UPortalGraphSubsystem : public UTickableWorldSubsystem, public IWorldPartitionStreamingSourceProvider
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	virtual bool GetStreamingSources(TArray<FWorldPartitionStreamingSource>& OutStreamingSources) const override;
+	virtual UObject* GetStreamingSourceOwner() override { return this; }
+
+	/** Region of the navmesh polygon under Location, INDEX_NONE when it reaches no portal. */
+	int32 FindRegion(const FVector& Location) const;
+
+	/** Region in front of Portal, INDEX_NONE when it is off the navmesh. */
+	int32 GetPortalRegion(const ATeleportPortal* Portal) const;
+
+	/** Portals to go through on the way from region From to region To, INDEX_NONE when there is no way. */
+	int32 GetHopCount(int32 From, int32 To) const;
+
+	/** First portal on the shortest way from region From to region To, null when they are the same or there is no way. */
+	ATeleportPortal* GetNextPortal(int32 From, int32 To) const;
+
+	/**
+	 * Where an agent at From walks next on its way to To: To itself when it is in the same region,
+	 * otherwise the nav point in front of OutPortal, the next portal to go through. Once there the
+	 * agent goes through with ATeleportPortal::TeleportFromNavPoint, the navmesh has no links across.
+	 * False when To cannot be reached through the portals.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool GetNextWaypoint(const FVector& From, const FVector& To, FVector& OutWaypoint, ATeleportPortal*& OutPortal) const;
+
+	// Portals past the one a player sees whose exits get loaded ahead of time
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0"))
+	int32 PrefetchHops = 2;
+
+	// How far a portal's floor point and a queried location may be from the navmesh
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0.0"))
+	float NavProjectionExtent = 100.0f;
+
+private:
+	// Unreachable in HopCounts
+	static constexpr uint8 NoPath = MAX_uint8;
+
+	void Rebuild();
+
+	/** Labels StartPoly and every polygon walkable from it with a new region. */
+	int32 AddRegion(const ARecastNavMesh& NavMesh, NavNodeRef StartPoly);
+
+	/** Fills SeenPortals and PrefetchPortals from what the last portal pass saw. */
+	void UpdatePrefetchPortals();
+
+	/** Loads and shows the sublevels of the exits of SeenPortals and PrefetchPortals. */
+	void UpdateLevelStreaming();
+
+	/** Streaming level Portal is in, null in the persistent level. */
+	ULevelStreaming* FindStreamingLevel(const ATeleportPortal* Portal) const;
+
+	void AddStreamingSource(TArray<FWorldPartitionStreamingSource>& OutStreamingSources, int32 Slot, EStreamingSourceTargetState TargetState, EStreamingSourcePriority Priority) const;
+
+	UFUNCTION()
+	void OnNavigationGenerationFinished(ANavigationData* InNavData);
+
+	// By slot of UPortalSubsystem
+	TArray<TWeakObjectPtr<ATeleportPortal>> Nodes;
+	TArray<FVector> NavPoints;
+	TArray<int32> NodeRegions;
+	// Slot of the linked portal, INDEX_NONE when the portal is off or leads nowhere registered
+	TArray<int32> ExitSlots;
+	TArray<FName> SourceNames;
+	// Sublevel of the exit, also when the exit streamed out
+	TArray<TWeakObjectPtr<ULevelStreaming>> ExitLevels;
+
+	// Sublevel of the exit of every portal that had one registered, by portal
+	TMap<TWeakObjectPtr<const ATeleportPortal>, TWeakObjectPtr<ULevelStreaming>> KnownExitLevels;
+
+	// Slots of the portals a local player sees, and of the ones up to PrefetchHops further
+	TArray<int32> SeenPortals;
+	TArray<int32> PrefetchPortals;
+
+	// Sublevels loaded only because an exit in them was in reach
+	TArray<TWeakObjectPtr<ULevelStreaming>> PrefetchedLevels;
+
+	// Region of every navmesh polygon a portal front can walk to
+	TMap<NavNodeRef, int32> PolyRegions;
+	int32 NumRegions = 0;
+
+	// Region count squared, the row is the region the way starts in
+	TArray<int32> NextPortals;
+	TArray<uint8> HopCounts;
+
+	TWeakObjectPtr<const ANavigationData> NavData;
+
+	uint32 BuiltTopologyVersion = MAX_uint32;
+	bool bNavigationChanged = true;
+};
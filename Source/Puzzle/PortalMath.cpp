@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalMath.h"
+
+FMatrix PortalMath::MakeViewMatrix(const FVector& ViewLocation, const FRotator& ViewRotation)
+{
+	return FTranslationMatrix(-ViewLocation) * FInverseRotationMatrix(ViewRotation) * FMatrix(
+		FPlane(0, 0, 1, 0),
+		FPlane(1, 0, 0, 0),
+		FPlane(0, 1, 0, 0),
+		FPlane(0, 0, 0, 1));
+}
+
+bool PortalMath::MakeObliqueProjection(const FMatrix& ProjectionMatrix, const FVector& ViewLocation, const FRotator& ViewRotation, const FPlane& ClipPlane, FMatrix& OutProjection)
+{
+	if (ProjectionMatrix.M[3][3] != 0.0f)
+	{
+		return false;
+	}
+
+	const FMatrix ViewMatrix = MakeViewMatrix(ViewLocation, ViewRotation);
+	const FVector Normal = ViewMatrix.TransformVector(ClipPlane.GetNormal());
+	const double Distance = -Normal.Dot(ViewMatrix.TransformPosition(ClipPlane.GetOrigin()));
+	if (Distance >= 0.0)
+	{
+		return false;
+	}
+
+	// Maior Normal.Dir / Dir.Z dentro do frustum, sempre num canto. Com essa escala o far plane
+	// passa pelo canto no infinito, nada visível é cortado e a precisão de depth é a melhor possível
+	const double MaxSlope = Normal.Z +
+		(FMath::Abs(Normal.X) - Normal.X * ProjectionMatrix.M[2][0]) / ProjectionMatrix.M[0][0] +
+		(FMath::Abs(Normal.Y) - Normal.Y * ProjectionMatrix.M[2][1]) / ProjectionMatrix.M[1][1];
+	if (MaxSlope <= UE_KINDA_SMALL_NUMBER)
+	{
+		return false;
+	}
+
+	// Coluna Z = coluna W - Scale * plano, assim z <= w (near) vira Plane.v >= 0
+	const double Scale = 1.0 / MaxSlope;
+	OutProjection = ProjectionMatrix;
+	OutProjection.M[0][2] = ProjectionMatrix.M[0][3] - Scale * Normal.X;
+	OutProjection.M[1][2] = ProjectionMatrix.M[1][3] - Scale * Normal.Y;
+	OutProjection.M[2][2] = ProjectionMatrix.M[2][3] - Scale * Normal.Z;
+	OutProjection.M[3][2] = ProjectionMatrix.M[3][3] - Scale * Distance;
+	return true;
+}
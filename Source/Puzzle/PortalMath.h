@@ -0,0 +1,18 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+namespace PortalMath
+{
+	/**
+	 * ProjectionMatrix with its near plane moved onto ClipPlane, so the frustum itself culls
+	 * everything behind the plane. Reversed Z like the engine's. False for orthographic views
+	 * and views starting in front of the plane, the oblique near plane does not work for them.
+	 */
+	PUZZLE_API bool MakeObliqueProjection(const FMatrix& ProjectionMatrix, const FVector& ViewLocation, const FRotator& ViewRotation, const FPlane& ClipPlane, FMatrix& OutProjection);
+
+	/** World to view space the way FSceneView builds it: X right, Y up, Z forward. */
+	PUZZLE_API FMatrix MakeViewMatrix(const FVector& ViewLocation, const FRotator& ViewRotation);
+}
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalMath.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	/** Reversed Z depth of a world point, NaN when it is behind the camera. */
+	double GetDepth(const FMatrix& ViewMatrix, const FMatrix& Projection, const FVector& Point)
+	{
+		const FVector4 Clip = Projection.TransformFVector4(FVector4(ViewMatrix.TransformPosition(Point), 1.0));
+		return Clip.W > 0.0 ? Clip.Z / Clip.W : TNumericLimits<double>::QuietNaN();
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalObliqueProjectionTest, "Puzzle.Portal.ObliqueProjection", EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FPortalObliqueProjectionTest::RunTest(const FString& Parameters)
+{
+	const FMatrix Perspective = FReversedZPerspectiveMatrix(FMath::DegreesToRadians(45.0f), 1920.0f, 1080.0f, 10.0f);
+
+	// Câmera inclinada atrás de um plano também inclinado, como a captura atrás do portal de saída
+	const FVector ViewLocation(-120.0, 40.0, 30.0);
+	const FRotator ViewRotation(-10.0, 15.0, 0.0);
+	const FVector PlaneOrigin(300.0, 90.0, 0.0);
+	const FVector PlaneNormal = FVector(0.9, 0.3, -0.2).GetSafeNormal();
+	const FPlane ClipPlane(PlaneOrigin, PlaneNormal);
+
+	FMatrix Projection;
+	if (!TestTrue(TEXT("Perspective view behind the plane gets an oblique projection"), PortalMath::MakeObliqueProjection(Perspective, ViewLocation, ViewRotation, ClipPlane, Projection)))
+	{
+		return false;
+	}
+
+	const FMatrix ViewMatrix = PortalMath::MakeViewMatrix(ViewLocation, ViewRotation);
+	FVector Tangent, Bitangent;
+	PlaneNormal.FindBestAxisVectors(Tangent, Bitangent);
+
+	// Pontos no plano ficam exatamente no near plane
+	for (const FVector2D& Offset : { FVector2D(0.0, 0.0), FVector2D(40.0, -25.0), FVector2D(-60.0, 35.0) })
+	{
+		const FVector Point = PlaneOrigin + Tangent * Offset.X + Bitangent * Offset.Y;
+		TestEqual(FString::Printf(TEXT("Depth on the plane at %s"), *Offset.ToString()), GetDepth(ViewMatrix, Projection, Point), 1.0, 1.0e-4);
+	}
+
+	// Atrás do plano passa do near plane (depth > 1 em reversed Z) e é cortado
+	const double BehindDepth = GetDepth(ViewMatrix, Projection, PlaneOrigin - PlaneNormal * 20.0);
+	TestTrue(FString::Printf(TEXT("Point behind the plane is clipped (depth %f)"), BehindDepth), BehindDepth > 1.0);
+
+	// Na frente do plano fica visível
+	const double FrontDepth = GetDepth(ViewMatrix, Projection, PlaneOrigin + PlaneNormal * 200.0);
+	TestTrue(FString::Printf(TEXT("Point in front of the plane is visible (depth %f)"), FrontDepth), FrontDepth > 0.0 && FrontDepth < 1.0);
+
+	// Cantos do frustum no infinito, direções em view space: nenhum passa do far plane e o mais fundo encosta nele
+	double MinCornerDepth = TNumericLimits<double>::Max();
+	for (const FVector2D& Corner : { FVector2D(-1.0, -1.0), FVector2D(-1.0, 1.0), FVector2D(1.0, -1.0), FVector2D(1.0, 1.0) })
+	{
+		const FVector4 Direction((Corner.X - Perspective.M[2][0]) / Perspective.M[0][0], (Corner.Y - Perspective.M[2][1]) / Perspective.M[1][1], 1.0, 0.0);
+		const FVector4 Clip = Projection.TransformFVector4(Direction);
+		const double Depth = Clip.Z / Clip.W;
+		TestTrue(FString::Printf(TEXT("Frustum corner %s at infinity is not clipped (depth %f)"), *Corner.ToString(), Depth), Depth >= -1.0e-6);
+		MinCornerDepth = FMath::Min(MinCornerDepth, Depth);
+	}
+	TestEqual(TEXT("Deepest frustum corner lies on the far plane"), MinCornerDepth, 0.0, 1.0e-6);
+
+	// Sem perspectiva não há near plane oblíquo
+	const FMatrix Orthographic = FReversedZOrthoMatrix(960.0f, 540.0f, 1.0f / 10000.0f, 0.0f);
+	FMatrix Unused;
+	TestFalse(TEXT("Orthographic view falls back to the clip plane"), PortalMath::MakeObliqueProjection(Orthographic, ViewLocation, ViewRotation, ClipPlane, Unused));
+
+	// Câmera já do lado visível do plano
+	const FVector FrontLocation = PlaneOrigin + PlaneNormal * 50.0;
+	TestFalse(TEXT("View in front of the plane falls back to the clip plane"), PortalMath::MakeObliqueProjection(Perspective, FrontLocation, ViewRotation, ClipPlane, Unused));
+
+	return true;
+}
+
+#endif
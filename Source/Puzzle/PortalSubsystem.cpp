@@ -0,0 +1,1016 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalSubsystem.h"
+
+#include "SceneView.h"
+#include "TeleportPortal.h"
+#include "Engine/GameViewportClient.h"
+#include "Engine/LocalPlayer.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
+
+DEFINE_LOG_CATEGORY(LogPortal);
+
+DEFINE_STAT(STAT_PortalTick);
+DEFINE_STAT(STAT_PortalVisibility);
+DEFINE_STAT(STAT_PortalsInFrustum);
+DEFINE_STAT(STAT_PortalVisibilityTraces);
+DEFINE_STAT(STAT_PortalSchedule);
+DEFINE_STAT(STAT_PortalCapturesIssued);
+DEFINE_STAT(STAT_PortalCapturesSkipped);
+DEFINE_STAT(STAT_PortalSceneRenders);
+DEFINE_STAT(STAT_PortalCapturePixels);
+DEFINE_STAT(STAT_PortalTargetSwaps);
+DEFINE_STAT(STAT_PortalQuery);
+DEFINE_STAT(STAT_PortalQueryHops);
+DEFINE_STAT(STAT_PortalPooledTargets);
+
+namespace
+{
+	void SetPortalCaptureBudget(const TArray<FString>& Args, UWorld* World)
+	{
+		UPortalSubsystem* Portals = World ? World->GetSubsystem<UPortalSubsystem>() : nullptr;
+		if (!Portals)
+		{
+			return;
+		}
+
+		if (Args.Num() > 0)
+		{
+			Portals->MaxCapturesPerFrame = FMath::Max(1, FCString::Atoi(*Args[0]));
+		}
+		if (Args.Num() > 1)
+		{
+			Portals->MaxSceneRendersPerFrame = FMath::Max(1, FCString::Atoi(*Args[1]));
+		}
+
+		const FPortalCaptureStats& Stats = Portals->GetCaptureStats();
+		UE_LOG(LogPortal, Display, TEXT("Portal capture budget: %d captures, %d scene renders per frame. Last frame: %d requested, %d issued, %d skipped, %d renders"),
+			Portals->MaxCapturesPerFrame,
+			Portals->MaxSceneRendersPerFrame,
+			Stats.Requested,
+			Stats.Issued,
+			Stats.Skipped,
+			Stats.SceneRenders);
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs PortalCaptureBudgetCommand(
+		TEXT("Portal.CaptureBudget"),
+		TEXT("Portal.CaptureBudget [Captures] [SceneRenders]: sets the per-frame portal capture budget and logs the last frame."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SetPortalCaptureBudget));
+
+	// Staleness keeps a small or off-screen portal from starving
+	constexpr float MinCaptureScreenSize = 0.01f;
+
+	/** Scene renders of a capture given Recursion, one per level. */
+	int32 GetCaptureCost(int32 Recursion)
+	{
+		return Recursion + 1;
+	}
+
+	/** First blocking hit of a single query, or an empty hit from Start to End. */
+	bool TakeBlockingHit(const TArray<FPortalHitResult>& Hits, const FVector& Start, const FVector& End, FPortalHitResult& OutHit)
+	{
+		if (Hits.Num() > 0 && Hits.Last().Hit.bBlockingHit)
+		{
+			OutHit = Hits.Last();
+			return true;
+		}
+
+		OutHit = FPortalHitResult();
+		OutHit.Hit = FHitResult(Start, End);
+		OutHit.QueryStart = Start;
+		return false;
+	}
+}
+
+FHitResult FPortalHitResult::GetUnfoldedHit() const
+{
+	FHitResult Unfolded = Hit;
+	if (NumHops == 0)
+	{
+		return Unfolded;
+	}
+
+	Unfolded.Location = ToQuerySpace.TransformPosition(Hit.Location);
+	Unfolded.ImpactPoint = ToQuerySpace.TransformPosition(Hit.ImpactPoint);
+	Unfolded.Normal = ToQuerySpace.TransformVectorNoScale(Hit.Normal);
+	Unfolded.ImpactNormal = ToQuerySpace.TransformVectorNoScale(Hit.ImpactNormal);
+	Unfolded.TraceStart = QueryStart;
+	Unfolded.TraceEnd = ToQuerySpace.TransformPosition(Hit.TraceEnd);
+	Unfolded.Time = Time;
+	Unfolded.Distance = FVector::Dist(QueryStart, Unfolded.Location);
+	return Unfolded;
+}
+
+FPortalCooldownKey::FPortalCooldownKey(const AActor* InActor, const ATeleportPortal* PortalA, const ATeleportPortal* PortalB)
+	: Actor(InActor)
+{
+	// A -> B e B -> A são o mesmo par
+	if (UPTRINT(PortalA) > UPTRINT(PortalB))
+	{
+		Swap(PortalA, PortalB);
+	}
+	First = PortalA;
+	Second = PortalB;
+}
+
+void FPortalTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Subsystem)
+	{
+		Subsystem->TickPortals(DeltaTime);
+	}
+}
+
+FString FPortalTickFunction::DiagnosticMessage()
+{
+	return TEXT("FPortalTickFunction");
+}
+
+FName FPortalTickFunction::DiagnosticContext(bool bDetailed)
+{
+	return FName(TEXT("PortalSubsystem"));
+}
+
+void UPortalSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	TickFunction.TickGroup = TG_PostUpdateWork;
+	TickFunction.bCanEverTick = true;
+	TickFunction.bStartWithTickEnabled = true;
+	TickFunction.Subsystem = this;
+	TickFunction.RegisterTickFunction(InWorld.PersistentLevel);
+}
+
+void UPortalSubsystem::Deinitialize()
+{
+	if (TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+	TickFunction.Subsystem = nullptr;
+
+	Super::Deinitialize();
+}
+
+int32 UPortalSubsystem::RegisterPortal(ATeleportPortal* Portal)
+{
+	check(Portal);
+
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		Slot = Portals.Num();
+		Portals.AddDefaulted();
+		States.Add(0);
+		NextOcclusionFrames.Add(0);
+		TracePoints.AddZeroed(TracesPerPortal);
+		TraceHandles.AddDefaulted(TracesPerPortal * MaxViews);
+		TracedViews.Add(0);
+		ScreenSizes.Add(0.0f);
+		Distances.Add(0.0f);
+		CaptureViews.Add(0);
+		LastCaptureFrames.Add(0);
+		ScheduledRecursions.Add(INDEX_NONE);
+		ResolutionLevels.Add(0);
+		DownscaleFrames.Add(0);
+		DirtyFlags.Add(EPortalDirtyFlags::None);
+		LinkedPortals.AddDefaulted();
+		Activations.Add(false);
+	}
+
+	Portals[Slot] = Portal;
+	States[Slot] = 0;
+	NextOcclusionFrames[Slot] = 0;
+	TracedViews[Slot] = 0;
+	ScreenSizes[Slot] = 0.0f;
+	Distances[Slot] = 0.0f;
+	CaptureViews[Slot] = 0;
+	// Nunca capturado, vai para o topo da fila
+	LastCaptureFrames[Slot] = 0;
+	ScheduledRecursions[Slot] = INDEX_NONE;
+	ResolutionLevels[Slot] = 0;
+	DownscaleFrames[Slot] = 0;
+	// O primeiro passe faz tudo
+	DirtyFlags[Slot] = EPortalDirtyFlags::All;
+	LinkedPortals[Slot] = Portal->LinkedPortal;
+	Activations[Slot] = Portal->bIsActivated;
+	++TopologyVersion;
+
+	// O eixo mais fino dos bounds é a normal do plano, os cantos ficam um pouco para dentro da moldura
+	const FBoxSphereBounds Local = Portal->PortalPlane->CalcBounds(FTransform::Identity);
+	const FVector Extent = Local.BoxExtent * 0.9f;
+	const int32 Thin = Extent.X <= Extent.Y ? (Extent.X <= Extent.Z ? 0 : 2) : (Extent.Y <= Extent.Z ? 1 : 2);
+	const int32 AxisA = (Thin + 1) % 3;
+	const int32 AxisB = (Thin + 2) % 3;
+
+	FVector* Points = &TracePoints[Slot * TracesPerPortal];
+	Points[0] = Local.Origin;
+	for (int32 Corner = 0; Corner < 4; ++Corner)
+	{
+		FVector Point = Local.Origin;
+		Point[AxisA] += (Corner & 1) ? Extent[AxisA] : -Extent[AxisA];
+		Point[AxisB] += (Corner & 2) ? Extent[AxisB] : -Extent[AxisB];
+		Points[Corner + 1] = Point;
+	}
+
+	return Slot;
+}
+
+void UPortalSubsystem::UnregisterPortal(int32 Slot)
+{
+	if (!Portals.IsValidIndex(Slot) || !Portals[Slot].IsValid())
+	{
+		return;
+	}
+
+	ATeleportPortal* Portal = Portals[Slot].Get();
+	ReleaseRenderTarget(Portal->Portal_RT);
+	Portal->Portal_RT = nullptr;
+
+	Portals[Slot].Reset();
+	States[Slot] = 0;
+	LinkedPortals[Slot].Reset();
+	FreeSlots.Add(Slot);
+	++TopologyVersion;
+}
+
+void UPortalSubsystem::TickPortals(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PortalTick);
+
+	// Teleportes de antes do update das câmeras já estão nelas
+	TeleportedViews.Reset();
+
+	// Quem perguntou antes neste frame (timer do BeginPlay, IsActorVisibleByCamera de Blueprint) viu as câmeras
+	// de antes do update, o passe sempre recalcula com as de agora
+	LastViewFrame = MAX_uint64;
+	LastVisibilityFrame = MAX_uint64;
+	LastScheduleFrame = MAX_uint64;
+	UpdateViews();
+
+	bool bViewportChanged = LastViewportSizes.Num() != Views.Num();
+	LastViewportSizes.SetNum(Views.Num());
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ++ViewIndex)
+	{
+		bViewportChanged |= LastViewportSizes[ViewIndex] != Views[ViewIndex].ViewportSize;
+		LastViewportSizes[ViewIndex] = Views[ViewIndex].ViewportSize;
+	}
+
+	if (bViewportChanged)
+	{
+		// Toda imagem está esticada, recaptura primeiro e no tamanho novo
+		for (int32 Slot = 0; Slot < Portals.Num(); ++Slot)
+		{
+			LastCaptureFrames[Slot] = 0;
+			DownscaleFrames[Slot] = 0;
+		}
+	}
+
+	// Todos os teleportes antes de qualquer captura
+	for (const TWeakObjectPtr<ATeleportPortal>& Entry : Portals)
+	{
+		ATeleportPortal* Portal = Entry.Get();
+		if (Portal && Portal->bIsActivated)
+		{
+			Portal->UpdateCrossings();
+		}
+	}
+
+	if (TeleportedViews.Num() > 0)
+	{
+		// DeltaTime zero só reposiciona a câmera no alvo, sem avançar lag nem blends
+		for (const TWeakObjectPtr<APlayerController>& Entry : TeleportedViews)
+		{
+			APlayerController* PC = Entry.Get();
+			if (PC && PC->PlayerCameraManager)
+			{
+				PC->PlayerCameraManager->UpdateCamera(0.0f);
+			}
+		}
+		TeleportedViews.Reset();
+
+		LastViewFrame = MAX_uint64;
+		LastVisibilityFrame = MAX_uint64;
+		LastScheduleFrame = MAX_uint64;
+	}
+
+	UpdateVisibility();
+	UpdateSchedule();
+
+	for (int32 Slot = 0; Slot < Portals.Num(); ++Slot)
+	{
+		ATeleportPortal* Portal = Portals[Slot].Get();
+		if (!Portal)
+		{
+			continue;
+		}
+
+		EPortalDirtyFlags Flags = DirtyFlags[Slot];
+		DirtyFlags[Slot] = EPortalDirtyFlags::None;
+		if (bViewportChanged)
+		{
+			Flags |= EPortalDirtyFlags::Viewport;
+		}
+		if (LinkedPortals[Slot].Get() != Portal->LinkedPortal)
+		{
+			LinkedPortals[Slot] = Portal->LinkedPortal;
+			Flags |= EPortalDirtyFlags::Linked;
+			++TopologyVersion;
+		}
+		if (Activations[Slot] != Portal->bIsActivated)
+		{
+			Activations[Slot] = Portal->bIsActivated;
+			Flags |= EPortalDirtyFlags::Activation;
+			++TopologyVersion;
+		}
+
+		Portal->UpdateRendering(Flags);
+	}
+}
+
+void UPortalSubsystem::MarkPortalDirty(int32 Slot, EPortalDirtyFlags Flags)
+{
+	if (DirtyFlags.IsValidIndex(Slot))
+	{
+		DirtyFlags[Slot] |= Flags;
+	}
+}
+
+void UPortalSubsystem::MarkViewTeleported(APlayerController* PlayerController)
+{
+	if (PlayerController && PlayerController->IsLocalController())
+	{
+		TeleportedViews.AddUnique(PlayerController);
+	}
+}
+
+bool UPortalSubsystem::IsPortalVisible(int32 Slot)
+{
+	if (!States.IsValidIndex(Slot))
+	{
+		return false;
+	}
+
+	UpdateVisibility();
+	return (States[Slot] & StateVisible) != 0;
+}
+
+bool UPortalSubsystem::WasPortalVisible(int32 Slot) const
+{
+	return States.IsValidIndex(Slot) && (States[Slot] & StateVisible) != 0;
+}
+
+bool UPortalSubsystem::IsPortalInFrustum(int32 Slot)
+{
+	if (!States.IsValidIndex(Slot))
+	{
+		return false;
+	}
+
+	UpdateVisibility();
+	return (States[Slot] & StateInFrustum) != 0;
+}
+
+bool UPortalSubsystem::ShouldCapture(int32 Slot, int32& OutRecursion)
+{
+	OutRecursion = INDEX_NONE;
+	if (!States.IsValidIndex(Slot))
+	{
+		return false;
+	}
+
+	UpdateSchedule();
+	OutRecursion = ScheduledRecursions[Slot];
+	return OutRecursion != INDEX_NONE;
+}
+
+TConstArrayView<FPortalView> UPortalSubsystem::GetViews()
+{
+	UpdateViews();
+	return Views;
+}
+
+const FPortalView* UPortalSubsystem::GetPrimaryView()
+{
+	UpdateViews();
+	return Views.Num() > 0 ? &Views[0] : nullptr;
+}
+
+const FPortalView* UPortalSubsystem::GetCaptureView(int32 Slot)
+{
+	UpdateVisibility();
+	if (Views.Num() == 0 || !CaptureViews.IsValidIndex(Slot))
+	{
+		return nullptr;
+	}
+	return &Views[FMath::Min(CaptureViews[Slot], Views.Num() - 1)];
+}
+
+void UPortalSubsystem::UpdateViews()
+{
+	if (LastViewFrame == GFrameCounter)
+	{
+		return;
+	}
+	LastViewFrame = GFrameCounter;
+
+	Views.Reset();
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return;
+	}
+
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It && Views.Num() < MaxViews; ++It)
+	{
+		APlayerController* PC = It->Get();
+		ULocalPlayer* LocalPlayer = PC ? PC->GetLocalPlayer() : nullptr;
+		if (!LocalPlayer || !PC->PlayerCameraManager || !LocalPlayer->ViewportClient || !LocalPlayer->ViewportClient->Viewport)
+		{
+			continue;
+		}
+
+		FSceneViewProjectionData ProjectionData;
+		if (!LocalPlayer->GetProjectionData(LocalPlayer->ViewportClient->Viewport, ProjectionData))
+		{
+			continue;
+		}
+
+		FPortalView& View = Views.AddDefaulted_GetRef();
+		View.PlayerController = PC;
+		View.CameraManager = PC->PlayerCameraManager;
+		View.Location = ProjectionData.ViewOrigin;
+		View.Rotation = PC->PlayerCameraManager->GetCameraRotation();
+		View.FOV = PC->PlayerCameraManager->GetFOVAngle();
+		View.ViewportSize = ProjectionData.GetConstrainedViewRect().Size();
+		View.ProjectionMatrix = ProjectionData.ProjectionMatrix;
+		View.ViewProjectionMatrix = ProjectionData.ComputeViewProjectionMatrix();
+		GetViewFrustumBounds(View.Frustum, View.ViewProjectionMatrix, false);
+		// Mesma conta do ComputeBoundsScreenSize: raio projetado em fração da tela
+		View.ScreenMultiple = FMath::Max(0.5f * View.ProjectionMatrix.M[0][0], 0.5f * View.ProjectionMatrix.M[1][1]);
+	}
+}
+
+void UPortalSubsystem::UpdateVisibility()
+{
+	if (LastVisibilityFrame == GFrameCounter)
+	{
+		return;
+	}
+	LastVisibilityFrame = GFrameCounter;
+
+	SCOPE_CYCLE_COUNTER(STAT_PortalVisibility);
+
+	UpdateViews();
+	if (Views.Num() == 0)
+	{
+		// Sem view não há o que renderizar
+		for (uint8& State : States)
+		{
+			State = 0;
+		}
+		return;
+	}
+
+	int32 NumInFrustum = 0;
+	for (int32 Slot = 0; Slot < Portals.Num(); ++Slot)
+	{
+		const ATeleportPortal* Portal = Portals[Slot].Get();
+		uint8& State = States[Slot];
+		if (!Portal || !Portal->bIsActivated)
+		{
+			State = 0;
+			continue;
+		}
+
+		// Fora de todos os frustums o portal fica com a view mais próxima, dentro com a que ele cobre mais
+		const FBoxSphereBounds& Bounds = Portal->PortalPlane->Bounds;
+		const FBox Box = Bounds.GetBox();
+		uint8 ViewMask = 0;
+		float BestScreenSize = 0.0f;
+		float NearestDistance = MAX_flt;
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ++ViewIndex)
+		{
+			const FPortalView& View = Views[ViewIndex];
+			const float Distance = FVector::Dist(Bounds.Origin, View.Location);
+			if (ViewMask == 0 && Distance < NearestDistance)
+			{
+				NearestDistance = Distance;
+				Distances[Slot] = Distance;
+				CaptureViews[Slot] = ViewIndex;
+			}
+
+			const bool bInRange = Box.ComputeSquaredDistanceToPoint(View.Location) <= FMath::Square(Portal->MaxRenderDistance);
+			if (!bInRange || !View.Frustum.IntersectBox(Bounds.Origin, Bounds.BoxExtent))
+			{
+				continue;
+			}
+
+			const float ScreenSize = View.GetScreenSize(Bounds, View.Location);
+			if (ViewMask == 0 || ScreenSize > BestScreenSize)
+			{
+				BestScreenSize = ScreenSize;
+				Distances[Slot] = Distance;
+				CaptureViews[Slot] = ViewIndex;
+			}
+			ViewMask |= 1 << ViewIndex;
+		}
+
+		ScreenSizes[Slot] = BestScreenSize;
+		if (ViewMask == 0)
+		{
+			// Traces pendentes simplesmente expiram
+			State = 0;
+			continue;
+		}
+		NumInFrustum++;
+		UpdateResolutionLevel(Slot);
+
+		if (!(State & StateInFrustum))
+		{
+			// Acabou de entrar na tela: assume visível até as traces responderem no próximo frame
+			State = StateInFrustum | StateVisible;
+			NextOcclusionFrames[Slot] = GFrameCounter;
+		}
+
+		if (State & StateTracePending)
+		{
+			bool bVisible = false;
+			if (ResolveTraces(Slot, bVisible))
+			{
+				State = bVisible ? (State | StateVisible) : (State & ~StateVisible);
+				NextOcclusionFrames[Slot] = GFrameCounter + OcclusionInterval;
+			}
+			State &= ~StateTracePending;
+		}
+
+		if (GFrameCounter >= NextOcclusionFrames[Slot])
+		{
+			IssueTraces(Slot, ViewMask);
+			State |= StateTracePending;
+		}
+	}
+
+	SET_DWORD_STAT(STAT_PortalsInFrustum, NumInFrustum);
+}
+
+void UPortalSubsystem::UpdateSchedule()
+{
+	if (LastScheduleFrame == GFrameCounter)
+	{
+		return;
+	}
+	LastScheduleFrame = GFrameCounter;
+
+	UpdateVisibility();
+
+	SCOPE_CYCLE_COUNTER(STAT_PortalSchedule);
+
+	Candidates.Reset();
+	for (int32 Slot = 0; Slot < Portals.Num(); ++Slot)
+	{
+		ScheduledRecursions[Slot] = INDEX_NONE;
+
+		const ATeleportPortal* Portal = Portals[Slot].Get();
+		if (!Portal || !Portal->bIsActivated || !Portal->LinkedPortal)
+		{
+			continue;
+		}
+		if (!(States[Slot] & StateVisible) && !Portal->bShouldAlwaysUpdateScreenCapture)
+		{
+			continue;
+		}
+
+		// Maior na tela, mais perto e há mais tempo sem captura vem primeiro
+		const float Staleness = (float)(GFrameCounter - LastCaptureFrames[Slot]);
+		const float DistanceFactor = 1.0f + Distances[Slot] / FMath::Max(Portal->DistanceToRenderFactor, 1.0f);
+		const float Priority = (ScreenSizes[Slot] + MinCaptureScreenSize) * Staleness / DistanceFactor;
+		Candidates.Emplace(Priority, Slot);
+	}
+
+	Candidates.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B)
+	{
+		return A.Key > B.Key;
+	});
+
+	CaptureStats = FPortalCaptureStats();
+	CaptureStats.Frame = GFrameCounter;
+	CaptureStats.Requested = Candidates.Num();
+
+	// CaptureStats.SceneRenders só conta o que as capturas renderizarem de fato, ver ReportCaptureRenders
+	int32 BudgetedRenders = 0;
+	TArray<FTransform, TInlineAllocator<8>> Levels;
+	for (const TPair<float, int32>& Candidate : Candidates)
+	{
+		const int32 Slot = Candidate.Value;
+		const int32 RemainingRenders = MaxSceneRendersPerFrame - BudgetedRenders;
+		if (CaptureStats.Issued >= MaxCapturesPerFrame || RemainingRenders < GetCaptureCost(0))
+		{
+			CaptureStats.Skipped++;
+			continue;
+		}
+
+		// A captura deferred renderiza um nível só, não reserva os outros
+		ATeleportPortal* Portal = Portals[Slot].Get();
+		int32 Recursion = Portal->bShouldCaptureAsync ? 0 : FMath::Clamp(Portal->MaxRecursion, 0, MaxCaptureRecursion);
+
+		// Os primeiros da fila levam a recursão inteira, os outros o que sobrou do orçamento
+		while (GetCaptureCost(Recursion) > RemainingRenders)
+		{
+			Recursion--;
+		}
+
+		// Níveis que MinRecursionPixels vai cortar não são renderizados, o orçamento fica para os próximos
+		if (Recursion > 0)
+		{
+			if (const FPortalView* View = GetCaptureView(Slot))
+			{
+				Portal->GetRecursionLevels(*View, View->Location, View->Rotation, Recursion + 1, MinRecursionPixels, Levels);
+				Recursion = FMath::Max(Levels.Num() - 1, 0);
+			}
+		}
+
+		ScheduledRecursions[Slot] = Recursion;
+		CaptureStats.Issued++;
+		BudgetedRenders += GetCaptureCost(Recursion);
+
+		// Troca o render target antes da captura, assim ele nunca aparece vazio
+		const FIntPoint Size = ApplyRenderTargetSize(Slot);
+		CaptureStats.Pixels += (int64)Size.X * Size.Y;
+	}
+
+	SET_DWORD_STAT(STAT_PortalCapturesIssued, CaptureStats.Issued);
+	SET_DWORD_STAT(STAT_PortalCapturesSkipped, CaptureStats.Skipped);
+	SET_DWORD_STAT(STAT_PortalCapturePixels, CaptureStats.Pixels);
+}
+
+void UPortalSubsystem::ReportCaptureRenders(int32 Slot, int32 SceneRenders)
+{
+	// Uma captura de fora do agendamento deste frame não entra nas estatísticas dele
+	if (CaptureStats.Frame != GFrameCounter || !ScheduledRecursions.IsValidIndex(Slot) || ScheduledRecursions[Slot] == INDEX_NONE)
+	{
+		return;
+	}
+
+	// Marcado só quando captura de fato, um agendamento refeito no mesmo frame não acha que já capturou
+	LastCaptureFrames[Slot] = GFrameCounter;
+	CaptureStats.SceneRenders += SceneRenders;
+	INC_DWORD_STAT_BY(STAT_PortalSceneRenders, SceneRenders);
+}
+
+int32 UPortalSubsystem::GetResolutionLevel(float ScreenSize) const
+{
+	if (ScreenSize <= 0.0f)
+	{
+		return MaxResolutionLevel;
+	}
+
+	// Nível 0 a partir de metade da tela, cada nível seguinte na metade do anterior
+	const int32 Level = FMath::CeilToInt32(FMath::Log2(0.5f / ScreenSize));
+	return FMath::Clamp(Level, 0, MaxResolutionLevel);
+}
+
+void UPortalSubsystem::UpdateResolutionLevel(int32 Slot)
+{
+	const int32 Desired = GetResolutionLevel(ScreenSizes[Slot]);
+	int32& Level = ResolutionLevels[Slot];
+
+	if (Desired < Level)
+	{
+		// Cresce na hora, um portal borrado bem na frente da câmera aparece
+		Level = Desired;
+		DownscaleFrames[Slot] = 0;
+	}
+	else if (GetResolutionLevel(ScreenSizes[Slot] * DownscaleMargin) > Level)
+	{
+		if (++DownscaleFrames[Slot] >= DownscaleDelayFrames)
+		{
+			Level++;
+			DownscaleFrames[Slot] = 0;
+		}
+	}
+	else
+	{
+		DownscaleFrames[Slot] = 0;
+	}
+}
+
+bool UPortalSubsystem::LineTraceSingleByChannel(FPortalHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, int32 MaxHops)
+{
+	// Shape vazio vira raycast dentro do SweepSingleByChannel
+	return SweepSingleByChannel(OutHit, Start, End, FQuat::Identity, Channel, FCollisionShape(), Params, MaxHops);
+}
+
+bool UPortalSubsystem::LineTraceMultiByObjectType(TArray<FPortalHitResult>& OutHits, const FVector& Start, const FVector& End, const FCollisionObjectQueryParams& ObjectParams, const FCollisionQueryParams& Params, int32 MaxHops)
+{
+	OutHits.Reset();
+	UWorld* World = GetWorld();
+	QueryThroughPortals(OutHits, Start, End, FQuat::Identity, FCollisionShape(), Params, MaxHops,
+		[World, &ObjectParams](const FVector& LegStart, const FVector& LegEnd, const FQuat&, const FCollisionQueryParams& LegParams, TArray<FHitResult>& OutLegHits)
+		{
+			// Queries por object type não bloqueiam, todos os hits contam
+			World->LineTraceMultiByObjectType(OutLegHits, LegStart, LegEnd, ObjectParams, LegParams);
+			return false;
+		});
+	return OutHits.Num() > 0;
+}
+
+bool UPortalSubsystem::SweepSingleByChannel(FPortalHitResult& OutHit, const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, int32 MaxHops)
+{
+	TArray<FPortalHitResult> Hits;
+	UWorld* World = GetWorld();
+	QueryThroughPortals(Hits, Start, End, Rotation, Shape, Params, MaxHops,
+		[World, Channel, &Shape](const FVector& LegStart, const FVector& LegEnd, const FQuat& LegRotation, const FCollisionQueryParams& LegParams, TArray<FHitResult>& OutLegHits)
+		{
+			FHitResult Hit;
+			if (!World->SweepSingleByChannel(Hit, LegStart, LegEnd, LegRotation, Channel, Shape, LegParams))
+			{
+				return false;
+			}
+			OutLegHits.Add(Hit);
+			return Hit.bBlockingHit;
+		});
+	return TakeBlockingHit(Hits, Start, End, OutHit);
+}
+
+bool UPortalSubsystem::SweepSingleByProfile(FPortalHitResult& OutHit, const FVector& Start, const FVector& End, const FQuat& Rotation, FName ProfileName, const FCollisionShape& Shape, const FCollisionQueryParams& Params, int32 MaxHops)
+{
+	TArray<FPortalHitResult> Hits;
+	UWorld* World = GetWorld();
+	QueryThroughPortals(Hits, Start, End, Rotation, Shape, Params, MaxHops,
+		[World, ProfileName, &Shape](const FVector& LegStart, const FVector& LegEnd, const FQuat& LegRotation, const FCollisionQueryParams& LegParams, TArray<FHitResult>& OutLegHits)
+		{
+			FHitResult Hit;
+			if (!World->SweepSingleByProfile(Hit, LegStart, LegEnd, LegRotation, ProfileName, Shape, LegParams))
+			{
+				return false;
+			}
+			OutLegHits.Add(Hit);
+			return Hit.bBlockingHit;
+		});
+	return TakeBlockingHit(Hits, Start, End, OutHit);
+}
+
+bool UPortalSubsystem::QueryThroughPortals(TArray<FPortalHitResult>& OutHits, const FVector& Start, const FVector& End, const FQuat& Rotation, const FCollisionShape& Shape, const FCollisionQueryParams& Params, int32 MaxHops, FPortalQueryLeg Leg)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PortalQuery);
+
+	const double Length = FVector::Dist(Start, End);
+	const FVector ShapeExtent = Shape.GetExtent();
+	const int32 Hops = FMath::Clamp(MaxHops, 0, MaxQueryHops);
+
+	FVector LegStart = Start;
+	FVector LegEnd = End;
+	FQuat LegRotation = Rotation;
+	FCollisionQueryParams LegParams = Params;
+	FTransform ToQuerySpace = FTransform::Identity;
+	ATeleportPortal* LastPortal = nullptr;
+	double Travelled = 0.0;
+	TArray<FHitResult> LegHits;
+
+	for (int32 Hop = 0;; ++Hop)
+	{
+		// Portal mais perto que o trecho atravessa; sem portal nos bounds do trecho é uma query comum
+		double CrossTime = 1.0;
+		ATeleportPortal* Crossed = Hop < Hops ? FindPortalCrossing(LegStart, LegEnd, ShapeExtent, CrossTime) : nullptr;
+
+		const FVector LegStop = Crossed ? FMath::Lerp(LegStart, LegEnd, CrossTime) : LegEnd;
+		FCollisionQueryParams QueryParams = LegParams;
+		if (Crossed)
+		{
+			QueryParams.AddIgnoredComponent(Crossed->PortalPlane);
+		}
+
+		LegHits.Reset();
+		const bool bBlocked = Leg(LegStart, LegStop, LegRotation, QueryParams, LegHits);
+
+		const double LegLength = FVector::Dist(LegStart, LegStop);
+		for (const FHitResult& LegHit : LegHits)
+		{
+			FPortalHitResult& Result = OutHits.AddDefaulted_GetRef();
+			Result.Hit = LegHit;
+			Result.NumHops = Hop;
+			Result.Time = Length > UE_SMALL_NUMBER ? (Travelled + LegHit.Time * LegLength) / Length : LegHit.Time;
+			Result.QueryStart = Start;
+			Result.ToQuerySpace = ToQuerySpace;
+			Result.Portal = LastPortal;
+		}
+
+		if (bBlocked || !Crossed)
+		{
+			return bBlocked;
+		}
+
+		// O resto da query continua saindo do portal ligado, que fica ignorado por ela
+		INC_DWORD_STAT(STAT_PortalQueryHops);
+		const FPortalThroughTransform& Through = Crossed->GetThroughTransform();
+		LegStart = Through.Matrix.TransformPosition(LegStop);
+		LegEnd = Through.Matrix.TransformPosition(LegEnd);
+		LegRotation = FTransform(Through.Matrix).GetRotation() * LegRotation;
+		ToQuerySpace = FTransform(Through.Inverse) * ToQuerySpace;
+		Travelled += LegLength;
+		LastPortal = Crossed;
+
+		LegParams = Params;
+		LegParams.AddIgnoredComponent(Crossed->LinkedPortal->PortalPlane);
+	}
+}
+
+ATeleportPortal* UPortalSubsystem::FindPortalCrossing(const FVector& Start, const FVector& End, const FVector& Extent, double& OutTime) const
+{
+	ATeleportPortal* Crossed = nullptr;
+	OutTime = 1.0;
+
+	const FBox SegmentBox = FBox(Start.ComponentMin(End), Start.ComponentMax(End)).ExpandBy(Extent);
+	for (const TWeakObjectPtr<ATeleportPortal>& Entry : Portals)
+	{
+		ATeleportPortal* Portal = Entry.Get();
+		double Time;
+		if (Portal && Portal->bIsActivated && Portal->LinkedPortal &&
+			Portal->PortalPlane->Bounds.GetBox().Intersect(SegmentBox) &&
+			Portal->GetSegmentCrossing(Start, End, Time) && Time < OutTime)
+		{
+			Crossed = Portal;
+			OutTime = Time;
+		}
+	}
+	return Crossed;
+}
+
+void UPortalSubsystem::AddTeleportCooldown(const AActor* Actor, const ATeleportPortal* Portal, const ATeleportPortal* LinkedPortal)
+{
+	ExpireCooldowns();
+	Cooldowns.Add(FPortalCooldownKey(Actor, Portal, LinkedPortal), GetWorld()->GetTimeSeconds() + TeleportCooldown);
+}
+
+bool UPortalSubsystem::IsOnTeleportCooldown(const AActor* Actor, const ATeleportPortal* Portal, const ATeleportPortal* LinkedPortal)
+{
+	if (Cooldowns.IsEmpty())
+	{
+		return false;
+	}
+
+	ExpireCooldowns();
+	const double* Expiry = Cooldowns.Find(FPortalCooldownKey(Actor, Portal, LinkedPortal));
+	return Expiry && *Expiry > GetWorld()->GetTimeSeconds();
+}
+
+void UPortalSubsystem::ExpireCooldowns()
+{
+	if (LastCooldownFrame == GFrameCounter || Cooldowns.IsEmpty())
+	{
+		return;
+	}
+	LastCooldownFrame = GFrameCounter;
+
+	// Atores destruídos também saem aqui, a chave não segura o ator
+	const double Now = GetWorld()->GetTimeSeconds();
+	for (auto It = Cooldowns.CreateIterator(); It; ++It)
+	{
+		if (It.Value() <= Now)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+FIntPoint UPortalSubsystem::GetRenderTargetSize(FIntPoint ViewportSize, int32 Level)
+{
+	return FIntPoint(FMath::Max(ViewportSize.X >> Level, 1), FMath::Max(ViewportSize.Y >> Level, 1));
+}
+
+FIntPoint UPortalSubsystem::ApplyRenderTargetSize(int32 Slot)
+{
+	ATeleportPortal* Portal = Portals[Slot].Get();
+	UTextureRenderTarget2D* Current = Portal->Portal_RT;
+	if (!Current)
+	{
+		return FIntPoint::ZeroValue;
+	}
+
+	const FPortalView* View = GetCaptureView(Slot);
+	const FIntPoint Size = View ? GetRenderTargetSize(View->ViewportSize, ResolutionLevels[Slot]) : FIntPoint::ZeroValue;
+	if (Size.X <= 0 || Size.Y <= 0 || (Current->SizeX == Size.X && Current->SizeY == Size.Y))
+	{
+		return FIntPoint(Current->SizeX, Current->SizeY);
+	}
+
+	Portal->SetRenderTarget(AcquireRenderTarget(Size));
+	ReleaseRenderTarget(Current);
+	INC_DWORD_STAT(STAT_PortalTargetSwaps);
+
+	return Size;
+}
+
+UTextureRenderTarget2D* UPortalSubsystem::AcquireRenderTarget(FIntPoint Size)
+{
+	// Do mais novo para o mais velho, o mais velho é o primeiro a sair do pool
+	for (int32 Index = FreeRenderTargets.Num() - 1; Index >= 0; --Index)
+	{
+		UTextureRenderTarget2D* RenderTarget = FreeRenderTargets[Index];
+		if (RenderTarget && RenderTarget->SizeX == Size.X && RenderTarget->SizeY == Size.Y)
+		{
+			FreeRenderTargets.RemoveAt(Index, EAllowShrinking::No);
+			DEC_DWORD_STAT(STAT_PortalPooledTargets);
+			return RenderTarget;
+		}
+	}
+
+	UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(this);
+	RenderTarget->bAutoGenerateMips = false;
+	RenderTarget->InitAutoFormat(Size.X, Size.Y);
+	RenderTarget->UpdateResourceImmediate(true);
+	return RenderTarget;
+}
+
+void UPortalSubsystem::ReleaseRenderTarget(UTextureRenderTarget2D* RenderTarget)
+{
+	if (!RenderTarget)
+	{
+		return;
+	}
+
+	if (FreeRenderTargets.Num() >= MaxPooledRenderTargets)
+	{
+		FreeRenderTargets[0]->ReleaseResource();
+		FreeRenderTargets.RemoveAt(0, EAllowShrinking::No);
+		DEC_DWORD_STAT(STAT_PortalPooledTargets);
+	}
+
+	FreeRenderTargets.Add(RenderTarget);
+	INC_DWORD_STAT(STAT_PortalPooledTargets);
+}
+
+bool UPortalSubsystem::ResolveTraces(int32 Slot, bool& bOutVisible) const
+{
+	UWorld* World = GetWorld();
+	bOutVisible = false;
+
+	for (int32 ViewIndex = 0; ViewIndex < MaxViews; ++ViewIndex)
+	{
+		if (!(TracedViews[Slot] & (1 << ViewIndex)))
+		{
+			continue;
+		}
+
+		for (int32 Index = 0; Index < TracesPerPortal; ++Index)
+		{
+			FTraceDatum Datum;
+			if (!World->QueryTraceData(TraceHandles[(Slot * MaxViews + ViewIndex) * TracesPerPortal + Index], Datum))
+			{
+				return false;
+			}
+
+			// O próprio portal e os jogadores são ignorados, qualquer hit é oclusão
+			if (Datum.OutHits.Num() == 0 || !Datum.OutHits[0].bBlockingHit)
+			{
+				bOutVisible = true;
+				return true;
+			}
+		}
+	}
+
+	return true;
+}
+
+void UPortalSubsystem::IssueTraces(int32 Slot, uint8 ViewMask)
+{
+	UWorld* World = GetWorld();
+	const ATeleportPortal* Portal = Portals[Slot].Get();
+	const FTransform& PlaneTransform = Portal->PortalPlane->GetComponentTransform();
+
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(PortalVisibility), false);
+	Params.AddIgnoredActor(Portal);
+	for (const FPortalView& View : Views)
+	{
+		Params.AddIgnoredActor(View.PlayerController->GetPawn());
+	}
+
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ++ViewIndex)
+	{
+		if (!(ViewMask & (1 << ViewIndex)))
+		{
+			continue;
+		}
+
+		for (int32 Index = 0; Index < TracesPerPortal; ++Index)
+		{
+			const FVector Target = PlaneTransform.TransformPosition(TracePoints[Slot * TracesPerPortal + Index]);
+			TraceHandles[(Slot * MaxViews + ViewIndex) * TracesPerPortal + Index] =
+				World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Views[ViewIndex].Location, Target, ECC_Visibility, Params);
+		}
+		INC_DWORD_STAT_BY(STAT_PortalVisibilityTraces, TracesPerPortal);
+	}
+
+	TracedViews[Slot] = ViewMask;
+}
@@ -0,0 +1,410 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ConvexVolume.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Engine/HitResult.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldCollision.h"
+#include "PortalSubsystem.generated.h"
+
+class APlayerCameraManager;
+class APlayerController;
+class ATeleportPortal;
+class UPortalSubsystem;
+class UTextureRenderTarget2D;
+
+PUZZLE_API DECLARE_LOG_CATEGORY_EXTERN(LogPortal, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("Portals"), STATGROUP_Portals, STATCAT_Advanced);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Portal Tick"), STAT_PortalTick, STATGROUP_Portals, PUZZLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Portal Visibility"), STAT_PortalVisibility, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portals In Frustum"), STAT_PortalsInFrustum, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Visibility Traces"), STAT_PortalVisibilityTraces, STATGROUP_Portals, PUZZLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Portal Capture Schedule"), STAT_PortalSchedule, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Captures Issued"), STAT_PortalCapturesIssued, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Captures Skipped"), STAT_PortalCapturesSkipped, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Scene Renders"), STAT_PortalSceneRenders, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Capture Pixels"), STAT_PortalCapturePixels, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Render Target Swaps"), STAT_PortalTargetSwaps, STATGROUP_Portals, PUZZLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Portal Queries"), STAT_PortalQuery, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Portal Query Hops"), STAT_PortalQueryHops, STATGROUP_Portals, PUZZLE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pooled Portal Render Targets"), STAT_PortalPooledTargets, STATGROUP_Portals, PUZZLE_API);
+
+/** What the capture scheduler handed out in one frame. */
+USTRUCT(BlueprintType)
+struct FPortalCaptureStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int64 Frame = 0;
+
+	// Portals that wanted a capture this frame
+	UPROPERTY(BlueprintReadOnly)
+	int32 Requested = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 Issued = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 Skipped = 0;
+
+	// Scene renders the issued captures made, recursion levels included
+	UPROPERTY(BlueprintReadOnly)
+	int32 SceneRenders = 0;
+
+	// Render target pixels of the issued captures, one recursion level
+	UPROPERTY(BlueprintReadOnly)
+	int64 Pixels = 0;
+};
+
+/** What changed about a portal since the portal pass last updated it. */
+enum class EPortalDirtyFlags : uint8
+{
+	None = 0,
+	// The portal's root moved
+	Moved = 1 << 0,
+	// LinkedPortal points somewhere else
+	Linked = 1 << 1,
+	// A local player's viewport changed size, or players came or went
+	Viewport = 1 << 2,
+	// bIsActivated flipped
+	Activation = 1 << 3,
+	All = Moved | Linked | Viewport | Activation
+};
+ENUM_CLASS_FLAGS(EPortalDirtyFlags);
+
+/**
+ * Runs the portal pass of UPortalSubsystem in TG_PostUpdateWork. Timers and tickable objects
+ * run before the camera update, a capture from there would use last frame's camera.
+ */
+USTRUCT()
+struct FPortalTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	UPortalSubsystem* Subsystem = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+	virtual FName DiagnosticContext(bool bDetailed) override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FPortalTickFunction> : public TStructOpsTypeTraitsBase2<FPortalTickFunction>
+{
+	enum { WithCopy = false };
+};
+
+/**
+ * What one local player sees in a frame, resolved once after the camera update.
+ * Pointers are only meant for the frame the view was taken in.
+ */
+struct FPortalView
+{
+	APlayerController* PlayerController = nullptr;
+	APlayerCameraManager* CameraManager = nullptr;
+
+	FVector Location = FVector::ZeroVector;
+	FRotator Rotation = FRotator::ZeroRotator;
+	float FOV = 90.0f;
+
+	// This player's part of the viewport, smaller than the window in split-screen
+	FIntPoint ViewportSize = FIntPoint::ZeroValue;
+
+	FMatrix ProjectionMatrix = FMatrix::Identity;
+	FMatrix ViewProjectionMatrix = FMatrix::Identity;
+	FConvexVolume Frustum;
+
+	// Projected radius per unit of distance, in screen fractions
+	float ScreenMultiple = 0.0f;
+
+	/** Fraction of the view height a sphere of Bounds covers seen from ViewLocation with this projection. */
+	float GetScreenSize(const FBoxSphereBounds& Bounds, const FVector& ViewLocation) const
+	{
+		return FMath::Min(2.0f * ScreenMultiple * Bounds.SphereRadius / FMath::Max(1.0f, FVector::Dist(Bounds.Origin, ViewLocation)), 1.0f);
+	}
+
+	float GetProjectedPixels(const FBoxSphereBounds& Bounds, const FVector& ViewLocation) const
+	{
+		return GetScreenSize(Bounds, ViewLocation) * ViewportSize.Y;
+	}
+};
+
+/** An actor and the two portals of a linked pair, in a fixed order. */
+struct FPortalCooldownKey
+{
+	TObjectKey<AActor> Actor;
+	TObjectKey<ATeleportPortal> First;
+	TObjectKey<ATeleportPortal> Second;
+
+	FPortalCooldownKey(const AActor* InActor, const ATeleportPortal* PortalA, const ATeleportPortal* PortalB);
+
+	bool operator==(const FPortalCooldownKey& Other) const
+	{
+		return Actor == Other.Actor && First == Other.First && Second == Other.Second;
+	}
+
+	friend uint32 GetTypeHash(const FPortalCooldownKey& Key)
+	{
+		return HashCombine(GetTypeHash(Key.Actor), HashCombine(GetTypeHash(Key.First), GetTypeHash(Key.Second)));
+	}
+};
+
+/** A hit of a query that may have gone through portals on its way. */
+struct FPortalHitResult
+{
+	// World space, on the far side of every portal the query went through
+	FHitResult Hit;
+
+	// Portals crossed before Hit
+	int32 NumHops = 0;
+
+	// Fraction of the whole query, Hit.Time only covers the part after the last portal
+	float Time = 1.0f;
+
+	FVector QueryStart = FVector::ZeroVector;
+
+	// Maps the space of Hit back to the space of the query, identity without hops
+	FTransform ToQuerySpace = FTransform::Identity;
+
+	// Last portal crossed, null without hops
+	TWeakObjectPtr<ATeleportPortal> Portal;
+
+	/** Hit as if the query had gone straight through every portal, all of it in the space of the query. */
+	FHitResult GetUnfoldedHit() const;
+};
+
+/**
+ * Updates every portal of the world in one pass per frame, after the camera update: first
+ * the teleports of all portals, then visibility, capture scheduling and the captures, so no
+ * capture sees an actor on the wrong side. Portal actors do not tick; anything that only
+ * changes when a portal moves, is relinked or the viewport resizes waits for a dirty flag.
+ *
+ * Resolves the view of every local player once per frame and answers "is this portal on
+ * screen" for every portal of the world from those views. A portal is captured for the
+ * player it covers most of, there is a single render target per portal even in split-screen.
+ * Portals outside the view frustums or MaxRenderDistance are rejected right away; the ones
+ * inside are checked for occlusion with async traces that resolve on the next frame, and
+ * keep their last answer in between, so the cost scales with the portals on screen.
+ *
+ * Also schedules the scene captures: portals that want one are ranked by screen size,
+ * distance and frames since their last capture, and only the first ones that fit in the
+ * per-frame budget capture, the rest wait for a later frame.
+ *
+ * Render targets come from a shared pool in a few sizes, the viewport halved once per
+ * resolution level. A portal's level follows its screen size, going up at once and
+ * down only after staying small for a while, and is applied right before it captures.
+ *
+ * Teleport cooldowns of every portal live here too, keyed by actor and portal pair,
+ * and expire together in one sweep per frame.
+ */
+UCLASS(Config=Game)
+class PUZZLE_API UPortalSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	int32 RegisterPortal(ATeleportPortal* Portal);
+	void UnregisterPortal(int32 Slot);
+
+	/** Registered portals by slot, null where a portal unregistered. */
+	TConstArrayView<TWeakObjectPtr<ATeleportPortal>> GetPortals() const { return Portals; }
+
+	/** Bumped whenever a portal registers, unregisters, is relinked or turned on or off. */
+	uint32 GetTopologyVersion() const { return TopologyVersion; }
+
+	/** The portal pass, run by TickFunction once per frame. */
+	void TickPortals(float DeltaTime);
+
+	/** Flags are handed to the portal on the next pass and cleared. */
+	void MarkPortalDirty(int32 Slot, EPortalDirtyFlags Flags);
+
+	/** Resolves PlayerController's view again after the teleports, so this frame's captures follow the jump. */
+	void MarkViewTeleported(APlayerController* PlayerController);
+
+	/** Views of every local player this frame, resolved on first use after the camera update. */
+	TConstArrayView<FPortalView> GetViews();
+
+	/** First local player's view, null when there is none. */
+	const FPortalView* GetPrimaryView();
+
+	/** View the portal in Slot is captured for, null when there is none. */
+	const FPortalView* GetCaptureView(int32 Slot);
+
+	/** Whether any local player sees the portal in Slot, updated at most once per frame. */
+	bool IsPortalVisible(int32 Slot);
+
+	/** What the last portal pass answered for IsPortalVisible, safe to read at any point of the frame. */
+	bool WasPortalVisible(int32 Slot) const;
+
+	/** Whether the portal in Slot is in range and in the frustum of any view, occluded or not. */
+	bool IsPortalInFrustum(int32 Slot);
+
+	/**
+	 * Whether the portal in Slot captures this frame. OutRecursion is the recursion depth
+	 * it was given, never more than its own MaxRecursion.
+	 */
+	bool ShouldCapture(int32 Slot, int32& OutRecursion);
+
+	/** Counts the scene renders the capture of the portal in Slot made this frame. */
+	void ReportCaptureRenders(int32 Slot, int32 SceneRenders);
+
+	const FPortalCaptureStats& GetCaptureStats() const { return CaptureStats; }
+
+	/** A render target of Size from the pool, created when none is free. */
+	UTextureRenderTarget2D* AcquireRenderTarget(FIntPoint Size);
+	void ReleaseRenderTarget(UTextureRenderTarget2D* RenderTarget);
+
+	/**
+	 * Collision queries that keep going through the portals they cross front to back, up to
+	 * MaxHops of them, each hop mapped with the pair's cached through transform. A query whose
+	 * bounds touch no portal plane costs a plain world query and a few box tests.
+	 */
+	bool LineTraceSingleByChannel(FPortalHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, int32 MaxHops = 1);
+	bool LineTraceMultiByObjectType(TArray<FPortalHitResult>& OutHits, const FVector& Start, const FVector& End, const FCollisionObjectQueryParams& ObjectParams, const FCollisionQueryParams& Params, int32 MaxHops = 1);
+	bool SweepSingleByChannel(FPortalHitResult& OutHit, const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, int32 MaxHops = 1);
+	bool SweepSingleByProfile(FPortalHitResult& OutHit, const FVector& Start, const FVector& End, const FQuat& Rotation, FName ProfileName, const FCollisionShape& Shape, const FCollisionQueryParams& Params, int32 MaxHops = 1);
+
+	/**
+	 * First active linked portal Start..End goes through front to back, with the fraction of the
+	 * segment where it does. Portals whose plane is not within Extent of the segment's bounds are
+	 * skipped without a test.
+	 */
+	ATeleportPortal* FindPortalCrossing(const FVector& Start, const FVector& End, const FVector& Extent, double& OutTime) const;
+
+	/** Keeps Actor from going through either portal of the pair for TeleportCooldown seconds. */
+	void AddTeleportCooldown(const AActor* Actor, const ATeleportPortal* Portal, const ATeleportPortal* LinkedPortal);
+	bool IsOnTeleportCooldown(const AActor* Actor, const ATeleportPortal* Portal, const ATeleportPortal* LinkedPortal);
+
+	// Portals captured per frame at most
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="1"))
+	int32 MaxCapturesPerFrame = 2;
+
+	// Scene renders per frame at most, a capture costs one render per recursion level
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="1"))
+	int32 MaxSceneRendersPerFrame = 8;
+
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0"))
+	int32 MaxCaptureRecursion = 3;
+
+	// A recursion level stops when the portal inside it covers fewer pixels than this
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0.0"))
+	float MinRecursionPixels = 24.0f;
+
+	// Each level halves the render target, a portal under 1/2^Level of the screen drops to it
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0", ClampMax="4"))
+	int32 MaxResolutionLevel = 3;
+
+	// Seconds an actor that just teleported ignores both portals of the pair
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0.0", Units="Seconds"))
+	float TeleportCooldown = 0.1f;
+
+	// Frames a portal has to stay small before its render target shrinks
+	UPROPERTY(Config, EditAnywhere, meta=(ClampMin="0"))
+	int32 DownscaleDelayFrames = 30;
+
+private:
+	static constexpr uint8 StateInFrustum = 0x01;
+	static constexpr uint8 StateVisible = 0x02;
+	static constexpr uint8 StateTracePending = 0x04;
+
+	// Center and four corners of the portal plane
+	static constexpr int32 TracesPerPortal = 5;
+
+	// Split-screen tops out at four local players
+	static constexpr int32 MaxViews = 4;
+
+	// Frames a visible portal keeps its occlusion answer before tracing again
+	static constexpr uint64 OcclusionInterval = 4;
+
+	// Shrinking needs the portal to fit the smaller level with this much room to spare
+	static constexpr float DownscaleMargin = 1.25f;
+
+	static constexpr int32 MaxPooledRenderTargets = 8;
+
+	// Hops a query takes at most, whatever the caller asks for
+	static constexpr int32 MaxQueryHops = 4;
+
+	/** Runs one leg of a portal query from Start to End, appends its hits and returns whether it was blocked. */
+	using FPortalQueryLeg = TFunctionRef<bool(const FVector& Start, const FVector& End, const FQuat& Rotation, const FCollisionQueryParams& Params, TArray<FHitResult>& OutHits)>;
+
+	/** Splits Start..End at the portals it goes through and runs Leg on each piece, until one is blocked. */
+	bool QueryThroughPortals(TArray<FPortalHitResult>& OutHits, const FVector& Start, const FVector& End, const FQuat& Rotation, const FCollisionShape& Shape, const FCollisionQueryParams& Params, int32 MaxHops, FPortalQueryLeg Leg);
+
+	void UpdateViews();
+	void UpdateVisibility();
+	void UpdateSchedule();
+
+	/** Drops every expired cooldown, at most once per frame. */
+	void ExpireCooldowns();
+
+	int32 GetResolutionLevel(float ScreenSize) const;
+	void UpdateResolutionLevel(int32 Slot);
+	static FIntPoint GetRenderTargetSize(FIntPoint ViewportSize, int32 Level);
+
+	/** Swaps the portal's render target when its level or the viewport changed, returns the size in use. */
+	FIntPoint ApplyRenderTargetSize(int32 Slot);
+
+	/** Reads back the traces issued last frame, false when they were lost and must be issued again. */
+	bool ResolveTraces(int32 Slot, bool& bOutVisible) const;
+	/** Traces the portal plane from every view in ViewMask. */
+	void IssueTraces(int32 Slot, uint8 ViewMask);
+
+	TArray<TWeakObjectPtr<ATeleportPortal>> Portals;
+	TArray<uint8> States;
+	TArray<uint64> NextOcclusionFrames;
+	// TracesPerPortal entries per slot, in the portal plane space
+	TArray<FVector> TracePoints;
+	// MaxViews * TracesPerPortal entries per slot, TracedViews has the views traced
+	TArray<FTraceHandle> TraceHandles;
+	TArray<uint8> TracedViews;
+
+	// Filled by UpdateVisibility, for the view the portal is captured for
+	TArray<float> ScreenSizes;
+	TArray<float> Distances;
+	TArray<int32> CaptureViews;
+
+	TArray<uint64> LastCaptureFrames;
+	// Recursion given to the slot this frame, INDEX_NONE when it does not capture
+	TArray<int32> ScheduledRecursions;
+	// Priority and slot, kept to avoid reallocating every frame
+	TArray<TPair<float, int32>> Candidates;
+
+	TArray<int32> ResolutionLevels;
+	TArray<int32> DownscaleFrames;
+
+	TArray<EPortalDirtyFlags> DirtyFlags;
+	// What the portal had on the last pass, compared to find relinks and activation changes
+	TArray<TWeakObjectPtr<ATeleportPortal>> LinkedPortals;
+	TArray<bool> Activations;
+
+	// Oldest first
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<UTextureRenderTarget2D>> FreeRenderTargets;
+
+	// World time each cooldown ends at
+	TMap<FPortalCooldownKey, double> Cooldowns;
+	uint64 LastCooldownFrame = MAX_uint64;
+
+	TArray<int32> FreeSlots;
+	uint32 TopologyVersion = 0;
+
+	TArray<FPortalView, TInlineAllocator<MaxViews>> Views;
+	uint64 LastViewFrame = MAX_uint64;
+	TArray<FIntPoint, TInlineAllocator<MaxViews>> LastViewportSizes;
+	TArray<TWeakObjectPtr<APlayerController>, TInlineAllocator<MaxViews>> TeleportedViews;
+
+	FPortalTickFunction TickFunction;
+
+	uint64 LastVisibilityFrame = MAX_uint64;
+	uint64 LastScheduleFrame = MAX_uint64;
+
+	FPortalCaptureStats CaptureStats;
+};
@@ -5,6 +5,8 @@
 
 #include "Interactable.h"
 #include "Pickup.h"
+#include "PortalSubsystem.h"
+#include "TeleportPortal.h"
 #include "WeightComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/SphereComponent.h"
@@ -90,13 +92,16 @@ void APuzzleCharacter::Tick(float DeltaSeconds)
 	FCollisionQueryParams QueryParams;
 	QueryParams.AddIgnoredActor(this); // Ignorar o próprio ator
 
-	TArray<FHitResult> InteractHits;
+	TArray<FPortalHitResult> InteractHits;
 
+	// Atravessa portais, dá para interagir com o que está do outro lado
 	bool hittedAnInteractable = false;
-	if (GetWorld()->LineTraceMultiByObjectType(InteractHits, TraceStart, TraceEnd, Traces, QueryParams))
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (Portals && Portals->LineTraceMultiByObjectType(InteractHits, TraceStart, TraceEnd, Traces, QueryParams))
 	{
-		for (const FHitResult& InteractHit : InteractHits)
+		for (const FPortalHitResult& PortalHit : InteractHits)
 		{
+			const FHitResult& InteractHit = PortalHit.Hit;
 			if (InteractHit.GetActor() != this && InteractHit.GetActor()->GetClass()->ImplementsInterface(UInteractable::StaticClass()))
 			{
 				if (ActorToInteract != InteractHit.GetActor())
@@ -121,3 +126,88 @@ void APuzzleCharacter::Tick(float DeltaSeconds)
 	}
 }
 
+bool APuzzleCharacter::SweepThirdPersonCamera(FHitResult& OutHit, const FVector& Start, const FVector& End,
+	ECollisionChannel TraceChannel, const FCollisionShape& Shape, const FCollisionQueryParams& Params) const
+{
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (!Portals)
+	{
+		return Super::SweepThirdPersonCamera(OutHit, Start, End, TraceChannel, Shape, Params);
+	}
+
+	// O plano do portal não empurra a câmera, só o que bloqueia do outro lado, trazido para o lado do personagem.
+	// GetThirdPersonCameraTransform leva a câmera de volta para o lado da saída
+	FPortalHitResult PortalHit;
+	const bool bHit = Portals->SweepSingleByChannel(PortalHit, Start, End, FQuat::Identity, TraceChannel, Shape, Params);
+	OutHit = PortalHit.GetUnfoldedHit();
+	return bHit;
+}
+
+FTransform APuzzleCharacter::GetThirdPersonCameraTransform(const FVector& TraceOrigin, const FTransform& CameraTransform) const
+{
+	// A câmera que passou do plano do portal renderiza do lado da saída, atrás do portal ela ficaria dentro da parede
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	double Time;
+	ATeleportPortal* Portal = Portals ? Portals->FindPortalCrossing(TraceOrigin, CameraTransform.GetLocation(), FVector::ZeroVector, Time) : nullptr;
+	if (!Portal)
+	{
+		return CameraTransform;
+	}
+
+	const FPortalThroughTransform& Through = Portal->GetThroughTransform();
+	return FTransform(
+		Through.TransformRotation(CameraTransform.Rotator()),
+		Through.Matrix.TransformPosition(CameraTransform.GetLocation()),
+		CameraTransform.GetScale3D());
+}
+
+bool APuzzleCharacter::SweepMantleLedge(FHitResult& OutHit, FTransform& OutSweepToHit, const FVector& Start, const FVector& End,
+	FName ProfileName, const FCollisionShape& Shape, const FCollisionQueryParams& Params)
+{
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (!Portals)
+	{
+		return Super::SweepMantleLedge(OutHit, OutSweepToHit, Start, End, ProfileName, Shape, Params);
+	}
+
+	FPortalHitResult PortalHit;
+	const bool bHit = Portals->SweepSingleByProfile(PortalHit, Start, End, FQuat::Identity, ProfileName, Shape, Params);
+	if (PortalHit.Portal.IsValid() && GetNetMode() != NM_Standalone)
+	{
+		// O mantle é replicado só com altura e alvo, o servidor e os outros clientes não passariam pelo portal
+		// e o CharacterMovement puxaria o personagem de volta. Em rede a borda do outro lado não conta
+		MantlePortal.Reset();
+		OutHit = FHitResult();
+		OutSweepToHit = FTransform::Identity;
+		return false;
+	}
+	OutHit = PortalHit.Hit;
+	OutSweepToHit = PortalHit.ToQuerySpace.Inverse();
+	MantlePortal = PortalHit.Portal;
+
+	double CrossTime;
+	MantleCrossing = MantlePortal.IsValid() && MantlePortal->GetSegmentCrossing(Start, End, CrossTime) ? FMath::Lerp(Start, End, CrossTime) : GetActorLocation();
+	return bHit;
+}
+
+void APuzzleCharacter::MoveToMantleSpace(const FTransform& SweepToHit)
+{
+	ATeleportPortal* Portal = MantlePortal.Get();
+	MantlePortal.Reset();
+	if (!Portal)
+	{
+		Super::MoveToMantleSpace(SweepToHit);
+		return;
+	}
+
+	// O personagem ainda está na frente da entrada, teleportar dali o põe atrás da saída, dentro da parede.
+	// Leva ele para onde a varredura cruzou o plano, na altura da cápsula e logo atrás do plano, assim
+	// ele sai na frente da saída com a cápsula inteira fora da parede
+	const FVector Normal = Portal->ForwardDirection->GetForwardVector();
+	const FVector Height = FVector::VectorPlaneProject(FVector(0.0, 0.0, GetActorLocation().Z - MantleCrossing.Z), Normal);
+	const FVector Entry = MantleCrossing + Height - Normal * (GetCapsuleComponent()->GetScaledCapsuleRadius() + 1.0f);
+	SetActorLocation(Entry, false, nullptr, ETeleportType::TeleportPhysics);
+
+	// Com rotação do controle, velocidade e cooldown como num teleporte normal
+	Portal->PerformTeleport(this);
+}
@@ -6,6 +6,8 @@
 #include "Character/ALSCharacter.h"
 #include "PuzzleCharacter.generated.h"
 
+class ATeleportPortal;
+
 /**
  * 
  */
@@ -24,6 +26,14 @@ public:
 
 	virtual void Tick(float DeltaSeconds) override;
 
+	/** Camera and mantle collision go through portals, mantles only in standalone games. */
+	virtual bool SweepThirdPersonCamera(FHitResult& OutHit, const FVector& Start, const FVector& End,
+		ECollisionChannel TraceChannel, const FCollisionShape& Shape, const FCollisionQueryParams& Params) const override;
+	virtual FTransform GetThirdPersonCameraTransform(const FVector& TraceOrigin, const FTransform& CameraTransform) const override;
+	virtual bool SweepMantleLedge(FHitResult& OutHit, FTransform& OutSweepToHit, const FVector& Start, const FVector& End,
+		FName ProfileName, const FCollisionShape& Shape, const FCollisionQueryParams& Params) override;
+	virtual void MoveToMantleSpace(const FTransform& SweepToHit) override;
+
 	UPROPERTY(BlueprintReadWrite)
 	FRotator InitialControllerRotation;
 
@@ -38,5 +48,10 @@ public:
 
 	UFUNCTION(BlueprintImplementableEvent)
 	void SmoothOrientation(FRotator newControlRotation);
-	
+
+private:
+	// Portal the last mantle sweep went through
+	TWeakObjectPtr<ATeleportPortal> MantlePortal;
+	// Where that sweep crossed the portal plane
+	FVector MantleCrossing = FVector::ZeroVector;
 };
@@ -4,24 +4,33 @@
 #include "TeleportPortal.h"
 
 #include "EngineUtils.h"
+#include "PortalMath.h"
+#include "PortalSubsystem.h"
 #include "PuzzleCharacter.h"
 #include "Camera/CameraComponent.h"
+#include "Camera/PlayerCameraManager.h"
 #include "Math/Vector.h"
 #include "Character/ALSCharacter.h"
 #include "Components/SceneCaptureComponent2D.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "GameFramework/Character.h"
 #include "GameFramework/PawnMovementComponent.h"
+#include "GameFramework/PlayerController.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "TP_FirstPerson/TP_FirstPersonCharacter.h"
 
+namespace
+{
+	// Uma busca na name table só, em vez de uma por checagem
+	const FName UnteleportableTag("Unteleportable");
+}
 
 // Sets default values
 ATeleportPortal::ATeleportPortal()
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// UPortalSubsystem atualiza todos os portais em um passe só
+	PrimaryActorTick.bCanEverTick = false;
 
 	DefaultSceneRoot = CreateDefaultSubobject<USceneComponent>(FName("Default Scene Root"));
 	RootComponent = DefaultSceneRoot;
@@ -46,7 +55,7 @@ ATeleportPortal::ATeleportPortal()
 	Detection->SetupAttachment(RootComponent);
 
 	UniqueID = FGuid::NewGuid();
-	this->Tags.Add("Unteleportable");
+	this->Tags.Add(UnteleportableTag);
 }
 
 // Called when the game starts or when spawned
@@ -56,10 +65,32 @@ void ATeleportPortal::BeginPlay()
 
 	GLog->Log("BeginPlay");
 
+	RootComponent->TransformUpdated.AddUObject(this, &ATeleportPortal::OnRootTransformUpdated);
+
+	// Quad do PortalPlane no espaço local, o eixo mais fino é a normal
+	const FBoxSphereBounds PlaneBounds = PortalPlane->CalcBounds(FTransform::Identity);
+	PlaneLocalBox = PlaneBounds.BoxExtent.IsNearlyZero() ? FBox(ForceInit) : PlaneBounds.GetBox();
+	const FVector& Extent = PlaneBounds.BoxExtent;
+	PlaneNormalAxis = Extent.X <= Extent.Y ? (Extent.X <= Extent.Z ? 0 : 2) : (Extent.Y <= Extent.Z ? 1 : 2);
+
+	Detection->OnComponentBeginOverlap.AddDynamic(this, &ATeleportPortal::OnDetectionBeginOverlap);
+	Detection->OnComponentEndOverlap.AddDynamic(this, &ATeleportPortal::OnDetectionEndOverlap);
+
+	TArray<AActor*> OverlappingActors;
+	Detection->GetOverlappingActors(OverlappingActors);
+	for (AActor* OverlappingActor : OverlappingActors)
+	{
+		AddCrossingCandidate(OverlappingActor);
+	}
+
+	if (UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>())
+	{
+		PortalSlot = Portals->RegisterPortal(this);
+	}
+
 	FTimerHandle DelayHandle;
 	GetWorld()->GetTimerManager().SetTimer(DelayHandle, [this]()
 	{
-		SetTickGroup(ETickingGroup::TG_PostUpdateWork);
 		this->CreateDynamicMaterialInstance();
 		if (LinkedPortal && Portal_RT)
 		{
@@ -69,184 +100,78 @@ void ATeleportPortal::BeginPlay()
 	}, 0.1f, false);
 }
 
-// Called every frame
-void ATeleportPortal::Tick(float DeltaTime)
+void ATeleportPortal::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
-
-	if(bIsActivated)
+	if (UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>())
 	{
-		bIsVisible = IsActorVisibleByCamera();
-		if((bIsVisible || bShouldAlwaysUpdateScreenCapture) && CalculatePortalTickAndCheckIfShouldRender()) {
-			UpdateSceneCaptureRecursive(FVector(), FRotator());
+		for (UTextureRenderTarget2D* Target : RecursionTargets)
+		{
+			Portals->ReleaseRenderTarget(Target);
 		}
-		PreventCameraClipping();
-		UpdateViewportSize();
-		CheckTeleportPlayer();
-		SetClipPlanes();
-	} else
+		Portals->UnregisterPortal(PortalSlot);
+	}
+	RecursionTargets.Reset();
+	PortalSlot = INDEX_NONE;
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ATeleportPortal::UpdateCrossings()
+{
+	CheckTeleportPlayer();
+	UpdateStraddleClones();
+}
+
+void ATeleportPortal::UpdateRendering(EPortalDirtyFlags DirtyFlags)
+{
+	if (!bIsActivated)
 	{
-		if(PortalPlane->IsVisible())
+		// Desativado não custa nada, só esconde na transição
+		if (EnumHasAnyFlags(DirtyFlags, EPortalDirtyFlags::Activation))
 		{
 			PortalPlane->SetVisibility(false);
+			HideStraddleClones(0);
 		}
+		return;
 	}
-}
 
-bool ATeleportPortal::CalculatePortalTickAndCheckIfShouldRender()
-{
-	TickAccumulatorToDistance++;
-	if (!CachedPlayerController)
+	if (EnumHasAnyFlags(DirtyFlags, EPortalDirtyFlags::Linked) && LinkedPortal && Portal_RT)
 	{
-		CachedPlayerController = UGameplayStatics::GetPlayerController(GetWorld(), 0);
+		LinkedPortal->PortalCamera->TextureTarget = Portal_RT;
+	}
+
+	bIsVisible = IsActorVisibleByCamera();
+	if((bIsVisible || bShouldAlwaysUpdateScreenCapture) && CalculatePortalTickAndCheckIfShouldRender()) {
+		UpdateSceneCaptureRecursive(FVector(), FRotator());
 	}
-	APlayerController* PC = CachedPlayerController;
-	if (!PC || !PC->PlayerCameraManager)
+
+	// Fora de todos os frustums ninguém vê o plano, a posição dele não importa
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (Portals && Portals->IsPortalInFrustum(PortalSlot))
 	{
-		return false;
+		PreventCameraClipping();
 	}
-    
-	const FVector CameraLocation = PC->PlayerCameraManager->GetCameraLocation();
-	float DistanceToCamera = FVector::Dist(GetActorLocation(), CameraLocation);
-	float DistanceTickFactor = FMath::Clamp(DistanceToCamera / DistanceToRenderFactor, 1.0f, FMath::Max(DistanceToRenderFactor, DistanceToCamera));
-	if (TickAccumulatorToDistance >= DistanceTickFactor)
+
+	// O clip plane só depende da posição deste portal e de ter um LinkedPortal
+	if (EnumHasAnyFlags(DirtyFlags, EPortalDirtyFlags::Moved | EPortalDirtyFlags::Linked | EPortalDirtyFlags::Activation))
 	{
-		TickAccumulatorToDistance = 0;
-		return true;
+		SetClipPlanes();
 	}
-	
-	return false;
+}
+
+bool ATeleportPortal::CalculatePortalTickAndCheckIfShouldRender()
+{
+	// O subsystem divide o orçamento de capturas do frame entre todos os portais
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	return Portals && Portals->ShouldCapture(PortalSlot, ScheduledRecursion);
 }
 
 
 bool ATeleportPortal::IsActorVisibleByCamera()
 {
-    // PlayerController e checagens básicas
-    APlayerController* PC = UGameplayStatics::GetPlayerController(GetWorld(), 0);
-    if (!PC || !PC->PlayerCameraManager)
-    {
-        return false;
-    }
-
-    // Pega a localização da câmera do jogador
-    const FVector CameraLocation = PC->PlayerCameraManager->GetCameraLocation();
-
-    // Bounding box do portal
-    const FBox BoundingBox = GetComponentsBoundingBox();
-    const FVector Min = BoundingBox.Min;
-    const FVector Max = BoundingBox.Max;
-
-    // Cantos do bounding box
-    TArray<FVector> Corners;
-    Corners.Add(FVector(Min.X, Min.Y, Min.Z));
-    Corners.Add(FVector(Min.X, Min.Y, Max.Z));
-    Corners.Add(FVector(Min.X, Max.Y, Min.Z));
-    Corners.Add(FVector(Min.X, Max.Y, Max.Z));
-    Corners.Add(FVector(Max.X, Min.Y, Min.Z));
-    Corners.Add(FVector(Max.X, Min.Y, Max.Z));
-    Corners.Add(FVector(Max.X, Max.Y, Min.Z));
-    Corners.Add(FVector(Max.X, Max.Y, Max.Z));
-    const FVector Center = (Min + Max) * 0.5f; // Adiciona o centro do portal
-    Corners.Add(Center);
-
-    // Tamanho do viewport (largura e altura em pixels)
-    int32 ViewportX = 0;
-    int32 ViewportY = 0;
-    PC->GetViewportSize(ViewportX, ViewportY);
-
-    // Função lambda para verificar visibilidade a partir de uma localização
-	auto IsVisibleFromLocation = [&](const FVector& ViewLocation, const FVector& ClipPlaneBase, const FVector& ClipPlaneNormal) -> bool
-    {
-        for (const FVector& Corner : Corners)
-        {
-            // Verifica se o canto está na frente do clip plane (se definido)
-            if (!ClipPlaneBase.IsZero() && !ClipPlaneNormal.IsZero())
-            {
-                FVector PointToPlane = Corner - ClipPlaneBase;
-                if (FVector::DotProduct(PointToPlane, ClipPlaneNormal) < 0)
-                {
-                    continue; // Está atrás do clip plane, ignora
-                }
-            }
-
-            // 1) Projecta o canto para as coordenadas de tela
-            FVector2D ScreenPos;
-            bool bOnScreen = UGameplayStatics::ProjectWorldToScreen(PC, Corner, ScreenPos);
-
-            // Se a projeção falhou ou está fora do viewport, ignora
-            if (!bOnScreen || ScreenPos.X < 0.f || ScreenPos.X > ViewportX ||
-                ScreenPos.Y < 0.f || ScreenPos.Y > ViewportY)
-            {
-                continue;
-            }
-
-            // 2) Traça um raio da localização até o canto para verificar obstruções
-            FHitResult HitResult;
-            FCollisionQueryParams QueryParams;
-            QueryParams.AddIgnoredActor(this); // Ignora o próprio portal
-            QueryParams.AddIgnoredActor(UGameplayStatics::GetPlayerPawn(GetWorld(), 0)); // Ignora o jogador
-
-            GetWorld()->LineTraceSingleByChannel(HitResult, ViewLocation, Corner, ECC_Visibility, QueryParams);
-
-            // Se o raio não atingir nada ou atingir o portal, o canto é considerado visível
-        	
-            if (!HitResult.bBlockingHit || HitResult.GetActor() == this)
-            {
-                const float DistToCorner = FVector::Dist(ViewLocation, Corner);
-                if (DistToCorner <= MaxRenderDistance)
-                {
-                    return true;
-                }
-            }
-        }
-        return false;
-    };
-
-    // Verifica se a câmera do jogador pode ver o portal
-    if (IsVisibleFromLocation(CameraLocation, FVector::Zero(), FVector::Zero()))
-    {
-        return true;
-    }
-
-    // Verifica se algum ATeleportPortal ativo pode ver o portal
-    // for (TActorIterator<ATeleportPortal> PortalItr(GetWorld()); PortalItr; ++PortalItr)
-    // {
-    //     ATeleportPortal* TeleportPortal = *PortalItr;
-    //
-    //     // Verifica se o portal está ativo
-    //     if (!TeleportPortal || !TeleportPortal->LinkedPortal || !TeleportPortal->LinkedPortal->bIsActivated)
-    //     {
-    //         continue;
-    //     }
-    //     if (TeleportPortal->LinkedPortal == this)
-    //     {
-    //         continue;
-    //     }
-    //
-    //     if (!TeleportPortal->LinkedPortal->PortalCamera)
-    //     {
-    //         continue;
-    //     }
-    //
-    //     // Obtém a câmera do portal
-    //     USceneCaptureComponent2D* Camera = TeleportPortal->LinkedPortal->PortalCamera;
-    //
-    //     // Verifica o plano de recorte (clip plane)
-    //     const FVector ClipPlaneBase = Camera->ClipPlaneBase;
-    //     const FVector ClipPlaneNormal = Camera->ClipPlaneNormal;
-    //
-    //     // Obtém a localização da câmera do portal
-    //     const FVector PortalCameraLocation = Camera->GetComponentLocation();
-    //
-    //     // Verifica se a câmera do portal pode ver este portal, considerando o clip plane
-    //     if (IsVisibleFromLocation(PortalCameraLocation, ClipPlaneBase, ClipPlaneNormal))
-    //     {
-    //         return true;
-    //     }
-    // }
-
-    // Se nenhum ator ou câmera puder ver o portal, retorna false
-    return false;
+	// Frustum, distância e oclusão ficam no subsystem, compartilhados entre todos os portais
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	return Portals && Portals->IsPortalVisible(PortalSlot);
 }
 
 void ATeleportPortal::CreateDynamicMaterialInstance()
@@ -257,20 +182,12 @@ void ATeleportPortal::CreateDynamicMaterialInstance()
 		Portal_MAT = DynamicMaterial;
 		PortalPlane->SetMaterial(0, Portal_MAT);
 
-		if(GEngine)
+		UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+		const FPortalView* View = Portals ? Portals->GetPrimaryView() : nullptr;
+		if (View)
 		{
-			if (ULocalPlayer* LocalPlayer = GEngine->GetFirstGamePlayer(GetWorld()))
-			{
-				if (LocalPlayer->ViewportClient)
-				{
-					auto size = LocalPlayer->ViewportClient->Viewport->GetSizeXY();
-					Portal_RT = NewObject<UTextureRenderTarget2D>();
-					Portal_RT->InitAutoFormat(size.X, size.Y);
-					Portal_RT->UpdateResourceImmediate(true);
-
-					Portal_RT->bAutoGenerateMips = false;
-				}
-			}
+			// Começa no tamanho do viewport, o subsystem reduz conforme o portal fica pequeno na tela
+			Portal_RT = Portals->AcquireRenderTarget(View->ViewportSize);
 		}
 
 		Portal_MAT->SetTextureParameterValue("Texture", Portal_RT);
@@ -278,6 +195,19 @@ void ATeleportPortal::CreateDynamicMaterialInstance()
 	}
 }
 
+void ATeleportPortal::SetRenderTarget(UTextureRenderTarget2D* RenderTarget)
+{
+	Portal_RT = RenderTarget;
+	if (Portal_MAT)
+	{
+		Portal_MAT->SetTextureParameterValue("Texture", Portal_RT);
+	}
+	if (LinkedPortal)
+	{
+		LinkedPortal->PortalCamera->TextureTarget = Portal_RT;
+	}
+}
+
 /** @Deprecated **/
 void ATeleportPortal::UpdateSceneCapture()
 {
@@ -300,7 +230,6 @@ void ATeleportPortal::SetClipPlanes()
 		FVector ClipPlaneBase = PortalPlane->GetComponentTransform().GetLocation() +
 			ForwardDirection->GetForwardVector() * clipPlanesFactor;
 		
-		PortalCamera->bEnableClipPlane = true;
 		PortalCamera->ClipPlaneBase = ClipPlaneBase;
 		PortalCamera->ClipPlaneNormal = ForwardDirection->GetForwardVector();		
 	}
@@ -308,8 +237,13 @@ void ATeleportPortal::SetClipPlanes()
 
 void ATeleportPortal::PreventCameraClipping()
 {
-	APlayerCameraManager* CameraManager =  UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0);
-	FVector CameraLocation = CameraManager->GetCameraLocation();
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	const FPortalView* View = Portals ? Portals->GetCaptureView(PortalSlot) : nullptr;
+	if (!View)
+	{
+		return;
+	}
+	FVector CameraLocation = View->Location;
 	
 	
 	double dot = UKismetMathLibrary::Dot_VectorVector(CameraLocation - GetActorLocation(), ForwardDirection->GetForwardVector());
@@ -324,119 +258,232 @@ void ATeleportPortal::PreventCameraClipping()
 	
 }
 
+/** @Deprecated: o tamanho do Portal_RT é controlado pelo UPortalSubsystem **/
 void ATeleportPortal::UpdateViewportSize()
 {
-	if(GEngine)
+}
+
+void ATeleportPortal::CheckTeleportPlayer()
+{
+	// Só quem está dentro do Detection, mantido pelos eventos de overlap.
+	// Teleportar pode disparar overlaps que adicionam ou marcam entradas, por isso o índice e nada de referências
+	for (int32 Index = 0; Index < Crossings.Num();)
 	{
-		if (ULocalPlayer* LocalPlayer = GEngine->GetFirstGamePlayer(GetWorld()))
+		AActor* Actor = Crossings[Index].Actor.Get();
+		bool bCrossed = Crossings[Index].bCrossed;
+		Crossings[Index].bCrossed = false;
+
+		if (Actor && !Crossings[Index].bLeft)
 		{
-			if (LocalPlayer->ViewportClient && Portal_RT)
-			{
-				auto size = LocalPlayer->ViewportClient->Viewport->GetSizeXY();
+			const FVector Position = Actor->GetActorLocation();
+			bCrossed |= IsSegmentCrossingPortal(Crossings[Index].LastPosition, Position);
+			Crossings[Index].LastPosition = Position;
+		}
 
-				if (! (Portal_RT->SizeX == size.X && Portal_RT->SizeY == size.Y))
-				{
-					Portal_RT->ResizeTarget(size.X, size.Y);
-				}
+		if (Actor && bCrossed && LinkedPortal)
+		{
+			if (ACharacter* Character = Cast<ACharacter>(Actor))
+			{
+				HandleCharacterTeleport(Character);
 			}
+			else
+			{
+				HandleActorTeleport(Actor);
+			}
+		}
+
+		if (!Actor || Crossings[Index].bLeft)
+		{
+			Crossings.RemoveAtSwap(Index, EAllowShrinking::No);
+		}
+		else
+		{
+			++Index;
 		}
 	}
 }
 
-void ATeleportPortal::CheckTeleportPlayer()
+void ATeleportPortal::OnDetectionBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor,
+	UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
 {
-	if (!LinkedPortal)
+	AddCrossingCandidate(OtherActor);
+}
+
+void ATeleportPortal::OnDetectionEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor,
+	UPrimitiveComponent* OtherComp, int32 OtherBodyIndex)
+{
+	// Ainda dentro por outro componente
+	if (!OtherActor || Detection->IsOverlappingActor(OtherActor))
 	{
 		return;
 	}
 
-	TArray<AActor*> OverlappingActors;
-	Detection->GetOverlappingActors(OverlappingActors);
+	FPortalCrossing* Crossing = Crossings.FindByPredicate([OtherActor](const FPortalCrossing& Candidate)
+	{
+		return Candidate.Actor == OtherActor;
+	});
+	if (!Crossing || Crossing->bLeft)
+	{
+		return;
+	}
 
-	FName TeleportedTag = FName("teleported" + UniqueID.ToString());
-	FName LinkedTeleportedTag = FName("teleported" + LinkedPortal->UniqueID.ToString());
+	// Rápido o bastante para atravessar e sair do Detection no mesmo frame; o teleporte fica para o próximo check
+	const FVector Position = OtherActor->GetActorLocation();
+	Crossing->bCrossed = IsSegmentCrossingPortal(Crossing->LastPosition, Position);
+	Crossing->LastPosition = Position;
+	Crossing->bLeft = true;
+}
 
-	for (AActor* OverlappingActor : OverlappingActors)
+void ATeleportPortal::AddCrossingCandidate(AActor* Actor)
+{
+	if (!Actor || Actor == this)
 	{
-		if (ACharacter* OverlappingCharacter = Cast<ACharacter>(OverlappingActor))
-		{
-			HandleCharacterTeleport(OverlappingCharacter, TeleportedTag, LinkedTeleportedTag);
-		}
-		else
-		{
-			HandleActorTeleport(OverlappingActor, TeleportedTag, LinkedTeleportedTag);
-		}
+		return;
 	}
 
+	if (FPortalCrossing* Existing = Crossings.FindByPredicate([Actor](const FPortalCrossing& Candidate)
+	{
+		return Candidate.Actor == Actor;
+	}))
+	{
+		// Voltou antes de ser removido, mantém a última posição
+		Existing->bLeft = false;
+		return;
+	}
+
+	FPortalCrossing& Crossing = Crossings.AddDefaulted_GetRef();
+	Crossing.Actor = Actor;
+	// Posição antes do movimento que gerou o overlap, quem entra já atravessando o plano também conta
+	Crossing.LastPosition = Actor->GetActorLocation() - Actor->GetVelocity() * GetWorld()->GetDeltaSeconds();
 }
 
-void ATeleportPortal::HandleCharacterTeleport(ACharacter* OverlappingCharacter, FName TeleportedTag,
-	FName LinkedTeleportedTag)
+bool ATeleportPortal::IsSegmentCrossingPortal(const FVector& Start, const FVector& End) const
+{
+	double Time;
+	return GetSegmentCrossing(Start, End, Time);
+}
+
+bool ATeleportPortal::GetSegmentCrossing(const FVector& Start, const FVector& End, double& OutTime) const
+{
+	const FVector PortalLocation = GetActorLocation();
+	const FVector PortalNormal = ForwardDirection->GetForwardVector();
+
+	// Só vale da frente para trás
+	const double StartDistance = PortalNormal.Dot(Start - PortalLocation);
+	const double EndDistance = PortalNormal.Dot(End - PortalLocation);
+	if (StartDistance < 0 || EndDistance >= 0)
+	{
+		return false;
+	}
+
+	OutTime = StartDistance / (StartDistance - EndDistance);
+	if (!PlaneLocalBox.IsValid)
+	{
+		return true;
+	}
+
+	// O ponto onde cruza o plano tem que cair dentro do quad do PortalPlane, não em qualquer lugar do plano infinito
+	const FVector Intersection = Start + (End - Start) * OutTime;
+	FVector Local = PortalPlane->GetComponentTransform().InverseTransformPosition(Intersection);
+	Local[PlaneNormalAxis] = PlaneLocalBox.GetCenter()[PlaneNormalAxis];
+
+	return PlaneLocalBox.IsInsideOrOn(Local);
+}
+
+bool ATeleportPortal::GetNavPoint(FVector& OutPoint) const
+{
+	// Portal no chão ou no teto não tem por onde andar até ele
+	const FVector Forward = ForwardDirection->GetForwardVector();
+	if (FMath::Abs(Forward.Z) > 0.5f)
+	{
+		return false;
+	}
+
+	OutPoint = GetActorLocation() + Forward.GetSafeNormal2D() * NavPointDistance;
+	OutPoint.Z = PortalPlane->Bounds.GetBox().Min.Z;
+	return true;
+}
+
+bool ATeleportPortal::TeleportFromNavPoint(APawn* Pawn)
+{
+	if (!Pawn || !LinkedPortal || !bIsActivated || IsOnTeleportCooldown(Pawn))
+	{
+		return false;
+	}
+
+	// Espelha para trás do plano, como se tivesse andado através dele, e sai na frente do LinkedPortal
+	const FVector Normal = ForwardDirection->GetForwardVector();
+	const FVector Location = Pawn->GetActorLocation();
+	const double Distance = FMath::Max(Normal.Dot(Location - GetActorLocation()), 1.0);
+	Pawn->SetActorLocation(Location - Normal * (2.0 * Distance), false, nullptr, ETeleportType::TeleportPhysics);
+	PerformTeleport(Pawn);
+	return true;
+}
+
+void ATeleportPortal::HandleCharacterTeleport(ACharacter* OverlappingCharacter)
 {
 	if (!OverlappingCharacter || !OverlappingCharacter->IsPlayerControlled())
 	{
 		return;
 	}
 
-	if (OverlappingCharacter->Tags.Contains(TeleportedTag) ||
-		OverlappingCharacter->Tags.Contains(LinkedTeleportedTag) ||
-		OverlappingCharacter->Tags.Contains("Unteleportable"))
+	if (OverlappingCharacter->Tags.Contains(UnteleportableTag) || IsOnTeleportCooldown(OverlappingCharacter))
 	{
 		return;
 	}
 
+	// O cruzamento já foi checado em CheckTeleportPlayer
 	if (AALSCharacter* CastedCharacter = Cast<AALSCharacter>(OverlappingCharacter))
 	{
-		FVector CharacterLocation = CastedCharacter->GetTransform().GetLocation();
-		FVector Velocity = CastedCharacter->GetVelocity();
-		if (IsPlayerCrossingPortal(CharacterLocation) && IsMovingTowardsPortal(Velocity))
-		{
-			PerformTeleport(CastedCharacter, TeleportedTag, LinkedTeleportedTag);
-		}
+		PerformTeleport(CastedCharacter);
 	}
 }
 
-void ATeleportPortal::HandleActorTeleport(AActor* OverlappingActor, FName TeleportedTag, FName LinkedTeleportedTag)
+void ATeleportPortal::HandleActorTeleport(AActor* OverlappingActor)
 {
 	if (!OverlappingActor ||
 		OverlappingActor == this ||
-		OverlappingActor->Tags.Contains(TeleportedTag) ||
-		OverlappingActor->Tags.Contains(LinkedTeleportedTag) ||
-		OverlappingActor->Tags.Contains("Unteleportable"))
+		OverlappingActor->Tags.Contains(UnteleportableTag) ||
+		IsOnTeleportCooldown(OverlappingActor))
 	{
 		return;
 	}
 
-	FVector Velocity = OverlappingActor->GetVelocity();
-	if(IsMovingTowardsPortal(Velocity))
-	{
-		DoTeleport(OverlappingActor);
-		AddTeleportTagsWithTimer(OverlappingActor, TeleportedTag, LinkedTeleportedTag);
-	}
+	DoTeleport(OverlappingActor);
+	AddTeleportCooldown(OverlappingActor);
 }
 
-void ATeleportPortal::PerformTeleport(AActor* Actor, FName TeleportedTag, FName LinkedTeleportedTag)
+void ATeleportPortal::PerformTeleport(AActor* Actor)
 {
-	DoTeleportPlayer();
-	AddTeleportTagsWithTimer(Actor, TeleportedTag, LinkedTeleportedTag);
+	if (ACharacter* Character = Cast<ACharacter>(Actor))
+	{
+		DoTeleportCharacter(Character);
+	}
+	else
+	{
+		DoTeleport(Actor);
+	}
+	AddTeleportCooldown(Actor);
 }
 
-void ATeleportPortal::AddTeleportTagsWithTimer(AActor* Actor, FName TeleportedTag, FName LinkedTeleportedTag)
+void ATeleportPortal::AddTeleportCooldown(AActor* Actor)
 {
-	if (!Actor)
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (Actor && Portals && LinkedPortal)
 	{
-		return;
+		Portals->AddTeleportCooldown(Actor, this, LinkedPortal);
 	}
+}
 
-	Actor->Tags.Add(TeleportedTag);
-	Actor->Tags.Add(LinkedTeleportedTag);
+bool ATeleportPortal::IsOnTeleportCooldown(const AActor* Actor)
+{
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	return Portals && LinkedPortal && Portals->IsOnTeleportCooldown(Actor, this, LinkedPortal);
+}
 
-	FTimerHandle TimerHandle;
-	GetWorld()->GetTimerManager().SetTimer(TimerHandle, FTimerDelegate::CreateLambda([Actor, TeleportedTag, LinkedTeleportedTag]()
-	{
-		Actor->Tags.Remove(TeleportedTag);
-		Actor->Tags.Remove(LinkedTeleportedTag);
-	}), 0.1f, false);
+void ATeleportPortal::AddTeleportTagsWithTimer(AActor* Actor, FName TeleportedTag, FName LinkedTeleportedTag)
+{
+	AddTeleportCooldown(Actor);
 }
 
 bool ATeleportPortal::IsMovingTowardsPortal(const FVector& Velocity)
@@ -445,9 +492,34 @@ bool ATeleportPortal::IsMovingTowardsPortal(const FVector& Velocity)
 	return FVector::DotProduct(Velocity, ForwardVector) < 0.0f; // Negativo significa movimento contra o ForwardVector
 }
 
+bool ATeleportPortal::IsPlayerCrossingPortal(FVector point)
+{
+	double Time;
+	const bool isCrossing = LastInFront && GetSegmentCrossing(LastPosition, point, Time);
+	LastInFront = ForwardDirection->GetForwardVector().Dot(point - GetActorLocation()) >= 0;
+	LastPosition = point;
+
+	return isCrossing;
+}
+
 void ATeleportPortal::DoTeleportPlayer()
 {
-	ACharacter* player = UGameplayStatics::GetPlayerCharacter(GetWorld(), 0);
+	if (ACharacter* Character = UGameplayStatics::GetPlayerCharacter(GetWorld(), 0))
+	{
+		PerformTeleport(Character);
+	}
+}
+
+void ATeleportPortal::RemoveTeleportTag(AActor* actorToRemoveTag)
+{
+	if (actorToRemoveTag)
+	{
+		actorToRemoveTag->Tags.Remove("teleported");
+	}
+}
+
+void ATeleportPortal::DoTeleportCharacter(ACharacter* player)
+{
 	if (player && LinkedPortal)
 	{
 		const FVector Location = DoTeleport_GetActorNewLocation(Cast<AActor>(player));
@@ -464,8 +536,17 @@ void ATeleportPortal::DoTeleportPlayer()
 		player->GetMovementComponent()->Velocity = UpdateActorVelocity(player->GetMovementComponent()->Velocity);
 
 		CallSmoothRotation(player, NewRotation);
-		
-		UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0)->SetGameCameraCutThisFrame();
+
+		// O corte é na câmera de quem atravessou, em split-screen não é o jogador 0
+		APlayerController* PlayerController = Cast<APlayerController>(player->GetController());
+		if (PlayerController && PlayerController->PlayerCameraManager)
+		{
+			PlayerController->PlayerCameraManager->SetGameCameraCutThisFrame();
+			if (UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>())
+			{
+				Portals->MarkViewTeleported(PlayerController);
+			}
+		}
 	}
 }
 
@@ -490,7 +571,12 @@ void ATeleportPortal::CallSmoothRotation(ACharacter* player, FRotator Rotation)
 
 void ATeleportPortal::DoTeleport(AActor* actorToTeleport)
 {
-	if (LinkedPortal)
+	UPrimitiveComponent* Body = Cast<UPrimitiveComponent>(actorToTeleport->GetRootComponent());
+	if (LinkedPortal && Body && Body->IsSimulatingPhysics())
+	{
+		DoTeleportPhysicsBody(actorToTeleport, Body);
+	}
+	else if (LinkedPortal)
 	{
 		const FVector Location = DoTeleport_GetActorNewLocation(actorToTeleport);
 		GEngine->AddOnScreenDebugMessage(1, 5.f, FColor::Red, actorToTeleport->GetName() + " -> Teleported to " + Location.ToString());
@@ -504,39 +590,118 @@ void ATeleportPortal::DoTeleport(AActor* actorToTeleport)
 		actorToTeleport->GetRootComponent()->ComponentVelocity =  UpdateActorVelocity(actorToTeleport->GetVelocity());
 		actorToTeleport->SetActorRotation(UpdateActorRotation(actorToTeleport->GetActorRotation()));
 		// player->GetMovementComponent()->Velocity = UpdatePlayerVelocity(player->GetMovementComponent()->Velocity);
-		
-		UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0)->SetGameCameraCutThisFrame();
+
+		UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+		if (const FPortalView* View = Portals ? Portals->GetPrimaryView() : nullptr)
+		{
+			View->CameraManager->SetGameCameraCutThisFrame();
+		}
 	}
 }
 
-FVector ATeleportPortal::UpdateActorVelocity(FVector Velocity)
+void ATeleportPortal::DoTeleportPhysicsBody(AActor* actorToTeleport, UPrimitiveComponent* Body)
 {
-	if (!LinkedPortal || Velocity.IsZero())
+	const FPortalThroughTransform& Through = GetThroughTransform();
+
+	// Lê antes de mover, o teleporte de física não mexe na velocidade mas é bom não depender disso
+	const FVector LinearVelocity = Body->GetPhysicsLinearVelocity();
+	const FVector AngularVelocity = Body->GetPhysicsAngularVelocityInDegrees();
+
+	// Mesma transformação da câmera do portal, mantém a escala do ator
+	const FVector Location = Through.Matrix.TransformPosition(actorToTeleport->GetActorLocation());
+	const FRotator Rotation = Through.TransformRotation(actorToTeleport->GetActorRotation());
+	actorToTeleport->SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+
+	// Velocidade angular é um vetor axial, gira igual porque a troca de lado do portal é uma rotação
+	Body->SetPhysicsLinearVelocity(Through.ArrowRotation.RotateVector(LinearVelocity));
+	Body->SetPhysicsAngularVelocityInDegrees(Through.ArrowRotation.RotateVector(AngularVelocity));
+}
+
+void ATeleportPortal::UpdateStraddleClones()
+{
+	int32 NumUsed = 0;
+	if (LinkedPortal)
 	{
-		return FVector();
+		const FVector PortalLocation = GetActorLocation();
+		const FVector PortalNormal = ForwardDirection->GetForwardVector();
+
+		for (const FPortalCrossing& Crossing : Crossings)
+		{
+			const AActor* Actor = Crossing.Actor.Get();
+			UStaticMeshComponent* Body = Actor ? Cast<UStaticMeshComponent>(Actor->GetRootComponent()) : nullptr;
+			if (!Body || Crossing.bLeft || !Body->IsSimulatingPhysics())
+			{
+				continue;
+			}
+
+			// Só enquanto o corpo está dos dois lados do plano
+			const FBoxSphereBounds& Bounds = Body->Bounds;
+			if (FMath::Abs(PortalNormal.Dot(Bounds.Origin - PortalLocation)) >= Bounds.SphereRadius)
+			{
+				continue;
+			}
+
+			// A parte que já passou aparece saindo do portal ligado
+			const FPortalThroughTransform& Through = GetThroughTransform();
+			const FTransform& BodyTransform = Body->GetComponentTransform();
+			UStaticMeshComponent* Clone = AcquireStraddleClone(NumUsed++, Body);
+			Clone->SetWorldTransform(FTransform(
+				Through.TransformRotation(BodyTransform.Rotator()),
+				Through.Matrix.TransformPosition(BodyTransform.GetLocation()),
+				BodyTransform.GetScale3D()));
+		}
 	}
 
-	// Obter os vetores de direção do portal de entrada
-	FVector ForwardVector = ForwardDirection->GetForwardVector();
-	FVector RightVector = ForwardDirection->GetRightVector();
-	FVector UpVector = ForwardDirection->GetUpVector();
+	HideStraddleClones(NumUsed);
+}
 
-	// Projeção da velocidade nos eixos do portal de entrada
-	float ForwardSpeed = FVector::DotProduct(Velocity, ForwardVector);
-	float RightSpeed = FVector::DotProduct(Velocity, RightVector);
-	float UpSpeed = FVector::DotProduct(Velocity, UpVector);
+void ATeleportPortal::HideStraddleClones(int32 FirstIndex)
+{
+	for (int32 Index = FirstIndex; Index < NumActiveStraddleClones; ++Index)
+	{
+		StraddleClones[Index]->SetVisibility(false);
+	}
+	NumActiveStraddleClones = FMath::Min(NumActiveStraddleClones, FirstIndex);
+}
 
-	// Inverter ou ajustar componentes conforme necessário
-	ForwardSpeed = -ForwardSpeed; // Inverter direção para frente, se necessário
-	RightSpeed = -RightSpeed;     // Manter direção lateral
-	UpSpeed = UpSpeed;           // Manter direção para cima
+UStaticMeshComponent* ATeleportPortal::AcquireStraddleClone(int32 Index, UStaticMeshComponent* Source)
+{
+	if (!StraddleClones.IsValidIndex(Index))
+	{
+		// Só visual, nunca colide nem gera overlap
+		UStaticMeshComponent* NewClone = NewObject<UStaticMeshComponent>(this);
+		NewClone->SetMobility(EComponentMobility::Movable);
+		NewClone->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		NewClone->SetGenerateOverlapEvents(false);
+		NewClone->RegisterComponent();
+		StraddleClones.Add(NewClone);
+		StraddleSources.AddDefaulted();
+	}
 
-	// Reconstruir a velocidade no espaço do portal de saída
-	FVector NewVelocity = LinkedPortal->ForwardDirection->GetForwardVector() * ForwardSpeed +
-						  LinkedPortal->ForwardDirection->GetRightVector() * RightSpeed +
-						  LinkedPortal->ForwardDirection->GetUpVector() * UpSpeed;
+	UStaticMeshComponent* Clone = StraddleClones[Index];
+	if (StraddleSources[Index] != Source)
+	{
+		StraddleSources[Index] = Source;
+		Clone->SetStaticMesh(Source->GetStaticMesh());
+		for (int32 Material = 0; Material < Source->GetNumMaterials(); ++Material)
+		{
+			Clone->SetMaterial(Material, Source->GetMaterial(Material));
+		}
+	}
+	Clone->SetVisibility(true);
+
+	return Clone;
+}
+
+FVector ATeleportPortal::UpdateActorVelocity(FVector Velocity)
+{
+	if (!LinkedPortal || Velocity.IsZero())
+	{
+		return FVector();
+	}
 
-	return NewVelocity;
+	// Frente e direita invertidas, cima mantido, do ForwardDirection de entrada para o de saída
+	return GetThroughTransform().ArrowRotation.RotateVector(Velocity);
 }
 
 FRotator ATeleportPortal::UpdateActorRotation(FRotator Rotation)
@@ -546,19 +711,9 @@ FRotator ATeleportPortal::UpdateActorRotation(FRotator Rotation)
 		return FRotator();
 	}
 
-	// Obter a rotação do portal de entrada e saída
-	FRotator PortalInRotation = ForwardDirection->GetComponentRotation();
-	FRotator PortalOutRotation = LinkedPortal->ForwardDirection->GetComponentRotation();
-
-	// Calcular o delta entre a rotação do ator e a do portal de entrada
-	FRotator RelativeRotation = Rotation - PortalInRotation;
-
-	// Ajustar para o espaço do portal de saída
-	FRotator NewRotation = PortalOutRotation + RelativeRotation;
-
-	// Inverter o yaw para apontar contra o portal de saída
-	//NewRotation.Yaw += 180.0f;
-	NewRotation.Normalize(); // Normalizar a rotação para evitar ângulos fora do intervalo válido
+	// Delta entre a rotação do portal de entrada e a do de saída, sem inverter o yaw
+	FRotator NewRotation = (GetThroughTransform().ArrowDelta * Rotation.Quaternion()).Rotator();
+	NewRotation.Normalize();
 
 	return NewRotation;
 }
@@ -567,16 +722,7 @@ FVector ATeleportPortal::DoTeleport_GetActorNewLocation(AActor* actor)
 {
 	if (actor && LinkedPortal)
 	{
-		FTransform T = GetActorTransform();
-		FVector Scale = T.GetScale3D();
-		Scale.X *= -1;
-		Scale.Y *= -1;
-		T.SetScale3D(Scale);
-
-
-		FVector Location = UKismetMathLibrary::InverseTransformLocation(T, actor->GetActorLocation());
-		Location = UKismetMathLibrary::TransformLocation(LinkedPortal->GetActorTransform(), Location);
-		return Location;
+		return GetThroughTransform().Matrix.TransformPosition(actor->GetActorLocation());
 	}
 
 	return FVector();
@@ -586,143 +732,132 @@ FRotator ATeleportPortal::DoTeleport_GetActorNewRotation(FRotator rotation)
 {
 	if (LinkedPortal)
 	{
-		FTransform portalTransform = LinkedPortal->GetActorTransform();
-		FVector X;
-		FVector Y;
-		FVector Z;
-		UKismetMathLibrary::GetAxes(rotation, X, Y, Z);
-		X = UKismetMathLibrary::InverseTransformDirection(GetActorTransform(), X);
-		X = UKismetMathLibrary::MirrorVectorByNormal(X, FVector(1, 0, 0));
-		X = UKismetMathLibrary::MirrorVectorByNormal(X, FVector(0, 1, 0));
-		X = UKismetMathLibrary::TransformDirection(portalTransform, X);
-
-		Y = UKismetMathLibrary::InverseTransformDirection(GetActorTransform(), Y);
-		Y = UKismetMathLibrary::MirrorVectorByNormal(Y, FVector(1, 0, 0));
-		Y = UKismetMathLibrary::MirrorVectorByNormal(Y, FVector(0, 1, 0));
-		Y = UKismetMathLibrary::TransformDirection(portalTransform, Y);
-
-		Z = UKismetMathLibrary::InverseTransformDirection(GetActorTransform(), Z);
-		Z = UKismetMathLibrary::MirrorVectorByNormal(Z, FVector(1, 0, 0));
-		Z = UKismetMathLibrary::MirrorVectorByNormal(Z, FVector(0, 1, 0));
-		Z = UKismetMathLibrary::TransformDirection(portalTransform, Z);
-
-		return UKismetMathLibrary::MakeRotationFromAxes(X, Y, Z);
+		return GetThroughTransform().TransformRotation(rotation);
 	}
 
 	return FRotator();
 }
 
-bool ATeleportPortal::IsPlayerCrossingPortal(FVector point)
-{
-	FVector PortalLocation = GetActorLocation();
-	FVector PortalNormal = ForwardDirection->GetForwardVector();
-
-	bool isInFront = PortalNormal.Dot(point - PortalLocation) >= 0;
-
-	FPlane FPortalPlane = UKismetMathLibrary::MakePlaneFromPointAndNormal(PortalLocation, PortalNormal);
-	float outT;
-	FVector outIntersection;
-
-	bool isIntersection = UKismetMathLibrary::LinePlaneIntersection(LastPosition, point, FPortalPlane, outT,
-	                                                                outIntersection);
-
-	bool isCrossing = (isIntersection && !isInFront && LastInFront);
-	LastInFront = isInFront;
-	LastPosition = point;
-
-	return isCrossing;
-}
-
 FRotator ATeleportPortal::UpdateSceneCapture_GetUpdatedSceneCaptureRotation(FRotator OldRotation)
 {
 	if (!LinkedPortal)
 	{
 		return FRotator();
 	}
-	FTransform ActorTransform = GetActorTransform();
 
+	return GetThroughTransform().TransformRotation(OldRotation);
+}
 
-	FVector X;
-	FVector Y;
-	FVector Z;
-	UKismetMathLibrary::BreakRotIntoAxes(OldRotation, X, Y, Z);
+void ATeleportPortal::UpdateSceneCaptureRecursive(FVector Location, FRotator Rotation)
+{
+	UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>();
+	if (!LinkedPortal || !Portals || !Portal_RT || !Portal_MAT)
+	{
+		return;
+	}
 
+	// Sem view inicial usa a câmera do jogador para quem o portal é capturado
+	const FPortalView* View = Portals->GetCaptureView(PortalSlot);
+	if (!View)
+	{
+		return;
+	}
+	if (Location.IsZero())
+	{
+		Location = View->Location;
+		Rotation = View->Rotation;
+	}
 
-	X = UKismetMathLibrary::InverseTransformDirection(ActorTransform, X);
-	X = UKismetMathLibrary::MirrorVectorByNormal(X, FVector(1, 0, 0));
-	X = UKismetMathLibrary::MirrorVectorByNormal(X, FVector(0, 1, 0));
-	FVector TransformDirectionForward = UKismetMathLibrary::TransformDirection(LinkedPortal->GetActorTransform(), X);
+	// A captura deferred só renderiza uma vez no fim do frame, com o último estado da câmera
+	const int32 MaxLevels = bShouldCaptureAsync ? 1 : FMath::Max(ScheduledRecursion, 0) + 1;
 
-	Y = UKismetMathLibrary::InverseTransformDirection(ActorTransform, Y);
-	Y = UKismetMathLibrary::MirrorVectorByNormal(Y, FVector(1, 0, 0));
-	Y = UKismetMathLibrary::MirrorVectorByNormal(Y, FVector(0, 1, 0));
-	FVector TransformDirectionRight = UKismetMathLibrary::TransformDirection(LinkedPortal->GetActorTransform(), Y);
+	TArray<FTransform, TInlineAllocator<8>> Levels;
+	GetRecursionLevels(*View, Location, Rotation, MaxLevels, Portals->MinRecursionPixels, Levels);
 
-	Z = UKismetMathLibrary::InverseTransformDirection(ActorTransform, Z);
-	Z = UKismetMathLibrary::MirrorVectorByNormal(Z, FVector(1, 0, 0));
-	Z = UKismetMathLibrary::MirrorVectorByNormal(Z, FVector(0, 1, 0));
-	FVector TransformDirectionUp = UKismetMathLibrary::TransformDirection(LinkedPortal->GetActorTransform(), Z);
+	// Do mais fundo para o mais raso, cada nível em um render target próprio com metade da resolução do anterior
+	USceneCaptureComponent2D* Camera = LinkedPortal->PortalCamera;
+	const FPlane& ExitPlane = GetThroughTransform().ExitPlane;
+	for (int32 Level = Levels.Num() - 1; Level >= 0; --Level)
+	{
+		const bool bDeepest = Level == Levels.Num() - 1;
+		if (bDeepest)
+		{
+			// Nada mais fundo para mostrar
+			PortalPlane->SetVisibility(false);
+		}
+		else
+		{
+			Portal_MAT->SetTextureParameterValue("Texture", GetRecursionTarget(Portals, Level + 1));
+		}
 
+		Camera->TextureTarget = Level == 0 ? Portal_RT : GetRecursionTarget(Portals, Level);
+		Camera->SetWorldLocationAndRotation(Levels[Level].GetLocation(), Levels[Level].GetRotation());
 
-	return UKismetMathLibrary::MakeRotationFromAxes(TransformDirectionForward, TransformDirectionRight,
-	                                                TransformDirectionUp);
-}
+		// Mesma projeção do jogador com o near plane no portal de saída; sem ela volta para o clip plane global
+		FMatrix Projection;
+		const bool bOblique = PortalMath::MakeObliqueProjection(View->ProjectionMatrix, Levels[Level].GetLocation(), Levels[Level].Rotator(), ExitPlane, Projection);
+		Camera->bUseCustomProjectionMatrix = bOblique;
+		Camera->bEnableClipPlane = !bOblique;
+		if (bOblique)
+		{
+			Camera->CustomProjectionMatrix = Projection;
+		}
 
-void ATeleportPortal::UpdateSceneCaptureRecursive(FVector Location, FRotator Rotation)
-{
+		if(bShouldCaptureAsync) {
+			Camera->CaptureSceneDeferred();
+		} else {
+			Camera->CaptureScene();
+		}
 
-	APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0);
-	if(LinkedPortal)
-	{
-		if(CurrentRecursion == 0) {
-			// PortalCamera->HiddenComponents.Add(Frame);
-			FVector TemporaryLocation = this->UpdateSceneCapture_GetUpdatedSceneCaptureLocation(CameraManager->GetCameraLocation());
-			FRotator TemporaryRotation = this->UpdateSceneCapture_GetUpdatedSceneCaptureRotation(CameraManager->GetCameraRotation());
-			CurrentRecursion++;
-			
-			UpdateSceneCaptureRecursive(TemporaryLocation, TemporaryRotation);
-			LinkedPortal->PortalCamera->SetWorldLocationAndRotation(TemporaryLocation, TemporaryRotation);
-			if(bShouldCaptureAsync) {
-				LinkedPortal->PortalCamera->CaptureSceneDeferred();
-			} else {
-				LinkedPortal->PortalCamera->CaptureScene();
-			}
-			CurrentRecursion = 0;
-		} else if(CurrentRecursion < MaxRecursion) {
-			//PortalCamera->HiddenComponents.Remove(Frame);
-			FVector TemporaryLocation = UpdateSceneCapture_GetUpdatedSceneCaptureLocation(Location);
-			FRotator TemporaryRotation = UpdateSceneCapture_GetUpdatedSceneCaptureRotation(Rotation);
-			CurrentRecursion++;
-			UpdateSceneCaptureRecursive(TemporaryLocation, TemporaryRotation);
-			LinkedPortal->PortalCamera->SetWorldLocationAndRotation(TemporaryLocation, TemporaryRotation);
-			if(bShouldCaptureAsync) {
-				LinkedPortal->PortalCamera->CaptureSceneDeferred();
-			} else {
-				LinkedPortal->PortalCamera->CaptureScene();
-			}
-		} else
+		if (bDeepest)
 		{
-			FVector TemporaryLocation = UpdateSceneCapture_GetUpdatedSceneCaptureLocation(Location);
-			FRotator TemporaryRotation = Rotation;
-			LinkedPortal->PortalCamera->SetWorldLocationAndRotation(TemporaryLocation, TemporaryRotation);
-			PortalPlane->SetVisibility(false);
-			if(bShouldCaptureAsync) {
-				LinkedPortal->PortalCamera->CaptureSceneDeferred();
-			} else {
-				LinkedPortal->PortalCamera->CaptureScene();
-			}
 			PortalPlane->SetVisibility(true);
 		}
 	}
-	
+
+	Portal_MAT->SetTextureParameterValue("Texture", Portal_RT);
+	CurrentRecursion = Levels.Num() - 1;
+	Portals->ReportCaptureRenders(PortalSlot, Levels.Num());
 }
 
-void ATeleportPortal::RemoveTeleportTag(AActor* actorToRemoveTag)
+void ATeleportPortal::GetRecursionLevels(const FPortalView& View, FVector Location, FRotator Rotation, int32 MaxLevels, float MinPixels, TArray<FTransform, TInlineAllocator<8>>& OutLevels)
 {
-		if (actorToRemoveTag)
+	OutLevels.Reset();
+
+	const FBoxSphereBounds& PlaneBounds = PortalPlane->Bounds;
+	const FVector PortalNormal = ForwardDirection->GetForwardVector();
+	while (OutLevels.Num() < MaxLevels)
+	{
+		Location = UpdateSceneCapture_GetUpdatedSceneCaptureLocation(Location);
+		Rotation = UpdateSceneCapture_GetUpdatedSceneCaptureRotation(Rotation);
+		OutLevels.Emplace(Rotation, Location);
+
+		// Este nível mostra o próprio portal de novo; o próximo só precisa existir se ele aparece grande o bastante
+		const bool bFacesPortal = PortalNormal.Dot(Location - GetActorLocation()) > 0.0f &&
+			Rotation.Vector().Dot(PlaneBounds.Origin - Location) > 0.0f;
+		if (!bFacesPortal || View.GetProjectedPixels(PlaneBounds, Location) < MinPixels)
 		{
-			actorToRemoveTag->Tags.Remove("teleported");
+			break;
 		}
+	}
+}
+
+UTextureRenderTarget2D* ATeleportPortal::GetRecursionTarget(UPortalSubsystem* Portals, int32 Level)
+{
+	const FIntPoint Size(FMath::Max(Portal_RT->SizeX >> Level, 1), FMath::Max(Portal_RT->SizeY >> Level, 1));
+	if (RecursionTargets.Num() < Level)
+	{
+		RecursionTargets.SetNumZeroed(Level);
+	}
+
+	// Fica com o portal entre capturas, só troca quando o Portal_RT muda de tamanho
+	UTextureRenderTarget2D*& Target = RecursionTargets[Level - 1];
+	if (!Target || Target->SizeX != Size.X || Target->SizeY != Size.Y)
+	{
+		Portals->ReleaseRenderTarget(Target);
+		Target = Portals->AcquireRenderTarget(Size);
+	}
+	return Target;
 }
 
 FVector ATeleportPortal::UpdateSceneCapture_GetUpdatedSceneCaptureLocation(FVector PlayerCameraLocation)
@@ -731,17 +866,60 @@ FVector ATeleportPortal::UpdateSceneCapture_GetUpdatedSceneCaptureLocation(FVect
 	{
 		return FVector();
 	}
-	FTransform actorTransform = GetActorTransform();
-	FVector scale = actorTransform.GetScale3D();
 
-	scale.X = -scale.X;
-	scale.Y = -scale.Y;
-	actorTransform.SetScale3D(scale);
-	
-	
-	FTransform LinkedPortalTransform = LinkedPortal->GetActorTransform();
-	FVector inverseTransformLocation = UKismetMathLibrary::InverseTransformLocation(actorTransform, PlayerCameraLocation);
+	return GetThroughTransform().Matrix.TransformPosition(PlayerCameraLocation);
+}
 
-	FVector updatedLocation = UKismetMathLibrary::TransformLocation(LinkedPortalTransform, inverseTransformLocation);
-	return updatedLocation;
+FRotator FPortalThroughTransform::TransformRotation(const FRotator& Rotation) const
+{
+	// Linhas da matriz de rotação são os eixos; a translação do Matrix cai na linha 3, que o Rotator() ignora
+	return (FRotationMatrix(Rotation) * Matrix).GetMatrixWithoutScale().Rotator();
+}
+
+const FPortalThroughTransform& ATeleportPortal::GetThroughTransform()
+{
+	check(LinkedPortal);
+
+	if (CachedThroughPortal == LinkedPortal &&
+		CachedThroughGeneration == TransformGeneration &&
+		CachedThroughLinkedGeneration == LinkedPortal->TransformGeneration)
+	{
+		return ThroughTransform;
+	}
+
+	// Espelha X e Y do portal de entrada, o que equivale a girar 180 graus em volta do Z local
+	FTransform Mirrored = GetActorTransform();
+	FVector Scale = Mirrored.GetScale3D();
+	Scale.X = -Scale.X;
+	Scale.Y = -Scale.Y;
+	Mirrored.SetScale3D(Scale);
+
+	ThroughTransform.Matrix = Mirrored.ToMatrixWithScale().Inverse() * LinkedPortal->GetActorTransform().ToMatrixWithScale();
+	ThroughTransform.Inverse = ThroughTransform.Matrix.Inverse();
+
+	const FQuat InArrow = ForwardDirection->GetComponentQuat();
+	const FQuat OutArrow = LinkedPortal->ForwardDirection->GetComponentQuat();
+	ThroughTransform.ArrowRotation = OutArrow * FQuat(FVector::UpVector, PI) * InArrow.Inverse();
+	ThroughTransform.ArrowDelta = OutArrow * InArrow.Inverse();
+
+	// Plano do portal de saída, deslocado pelo clipPlanesFactor como no SetClipPlanes
+	const FVector ExitNormal = LinkedPortal->ForwardDirection->GetForwardVector();
+	ThroughTransform.ExitPlane = FPlane(LinkedPortal->GetActorLocation() + ExitNormal * LinkedPortal->clipPlanesFactor, ExitNormal);
+
+	CachedThroughPortal = LinkedPortal;
+	CachedThroughGeneration = TransformGeneration;
+	CachedThroughLinkedGeneration = LinkedPortal->TransformGeneration;
+
+	return ThroughTransform;
+}
+
+void ATeleportPortal::OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	// Invalida o cache deste portal e o de qualquer portal ligado a ele
+	TransformGeneration++;
+
+	if (UPortalSubsystem* Portals = GetWorld()->GetSubsystem<UPortalSubsystem>())
+	{
+		Portals->MarkPortalDirty(PortalSlot, EPortalDirtyFlags::Moved);
+	}
 }
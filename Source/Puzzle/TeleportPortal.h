@@ -6,8 +6,41 @@
 #include "Components/ArrowComponent.h"
 #include "Components/BoxComponent.h"
 #include "GameFramework/Actor.h"
+#include "PortalSubsystem.h"
 #include "TeleportPortal.generated.h"
 
+/**
+ * Maps world space in front of a portal to world space in front of its linked portal.
+ * Matrix uses FMatrix row vectors, so it transforms positions and directions alike.
+ */
+struct FPortalThroughTransform
+{
+	FMatrix Matrix = FMatrix::Identity;
+	// Back through the portal, the same as the linked portal's Matrix when it links back
+	FMatrix Inverse = FMatrix::Identity;
+
+	// Between the ForwardDirection arrows, forward and right flipped, for velocities
+	FQuat ArrowRotation = FQuat::Identity;
+	// Between the ForwardDirection arrows without the flip
+	FQuat ArrowDelta = FQuat::Identity;
+
+	// The linked portal's plane, facing the side its captures look at. Captures cut everything behind it
+	FPlane ExitPlane = FPlane(ForceInit);
+
+	FRotator TransformRotation(const FRotator& Rotation) const;
+};
+
+/** An actor inside a portal's Detection box and where it was on the last check. */
+struct FPortalCrossing
+{
+	TWeakObjectPtr<AActor> Actor;
+	FVector LastPosition = FVector::ZeroVector;
+	// Left Detection, dropped on the next check
+	bool bLeft = false;
+	// Crossed the portal on its way out of Detection, teleported on the next check
+	bool bCrossed = false;
+};
+
 UCLASS()
 class PUZZLE_API ATeleportPortal : public AActor
 {
@@ -35,6 +68,9 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	UBoxComponent* Detection;
 
+	// How far in front of the plane AI walks to before going through
+	UPROPERTY(EditAnywhere)
+	float NavPointDistance = 60.0f;
 
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
@@ -46,9 +82,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	ATeleportPortal* LinkedPortal;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
+	// @Deprecated: only IsPlayerCrossingPortal uses them, CheckTeleportPlayer keeps a position per actor
+	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, meta=(DeprecatedProperty, DeprecationMessage="Crossings are tracked per actor by CheckTeleportPlayer."))
 	FVector LastPosition;
-	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
+	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, meta=(DeprecatedProperty, DeprecationMessage="Crossings are tracked per actor by CheckTeleportPlayer."))
 	bool LastInFront;
 
 	UPROPERTY(EditAnywhere)
@@ -73,32 +110,93 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
 	float DistanceToRenderFactor = 2000.f;
 	
+	// Recursion levels rendered by the last capture
 	UPROPERTY(VisibleAnywhere)
 	int CurrentRecursion;
 
+	// Recursion given by the capture scheduler for this frame, at most MaxRecursion
+	UPROPERTY(VisibleAnywhere)
+	int32 ScheduledRecursion = 0;
+
 	UPROPERTY(VisibleAnywhere)
 	FGuid UniqueID;
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	/** Teleports and straddle clones, run by UPortalSubsystem for every portal before any capture. */
+	void UpdateCrossings();
+
+	/** Capture, plane offset and clip planes, run by UPortalSubsystem after every portal's teleports. */
+	void UpdateRendering(EPortalDirtyFlags DirtyFlags);
+
+	/** Asks UPortalSubsystem whether this portal got one of the frame's captures. */
 	bool CalculatePortalTickAndCheckIfShouldRender();
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float MaxRenderDistance = 5000.0f;
 
+	/** Whether the first local player sees the portal plane, answered by UPortalSubsystem. */
 	UFUNCTION(BlueprintCallable)
 	bool IsActorVisibleByCamera();
 
+	/** Through-portal transform to LinkedPortal, rebuilt only after either portal moved. Needs LinkedPortal. */
+	const FPortalThroughTransform& GetThroughTransform();
+
+	/**
+	 * Where Start..End goes through the PortalPlane quad from front to back, as a fraction of the
+	 * segment. False when it misses the quad or crosses the other way.
+	 */
+	bool GetSegmentCrossing(const FVector& Start, const FVector& End, double& OutTime) const;
+
+	/** Sends Actor through to LinkedPortal and puts it on cooldown for the pair. */
+	UFUNCTION(BlueprintCallable)
+	void PerformTeleport(AActor* Actor);
+
+	/**
+	 * Sends Pawn, standing at the nav point, through to LinkedPortal as if it had walked through the
+	 * plane. False when the portal is off, unlinked or Pawn is on cooldown for the pair.
+	 */
+	bool TeleportFromNavPoint(class APawn* Pawn);
+
+	/** Points the material and the linked portal's camera at RenderTarget. */
+	void SetRenderTarget(UTextureRenderTarget2D* RenderTarget);
+
+	/** Floor point NavPointDistance in front of the portal, false when the portal does not stand upright. */
+	bool GetNavPoint(FVector& OutPoint) const;
+
+	int32 GetPortalSlot() const { return PortalSlot; }
+
+	/**
+	 * Where the capture of each recursion level looks from, shallowest first, up to MaxLevels
+	 * of them starting at Location/Rotation seen through the portal. Stops after the first level
+	 * in which the portal covers fewer than MinPixels of View. Needs LinkedPortal.
+	 */
+	void GetRecursionLevels(const FPortalView& View, FVector Location, FRotator Rotation, int32 MaxLevels, float MinPixels, TArray<FTransform, TInlineAllocator<8>>& OutLevels);
+
 private:
-	UPROPERTY(VisibleAnywhere)
-	APlayerController* CachedPlayerController;
-	UPROPERTY(VisibleAnywhere)
-	int TickAccumulatorToDistance = 0;
+	// Slot in UPortalSubsystem
+	int32 PortalSlot = INDEX_NONE;
+
+	// Bumped whenever the root moves, the through transforms of this portal and the ones linked to it compare against it
+	uint32 TransformGeneration = 0;
+
+	FPortalThroughTransform ThroughTransform;
+	TWeakObjectPtr<const ATeleportPortal> CachedThroughPortal;
+	uint32 CachedThroughGeneration = MAX_uint32;
+	uint32 CachedThroughLinkedGeneration = MAX_uint32;
+
+	// Actors inside Detection, few enough that a flat array beats a map
+	TArray<FPortalCrossing> Crossings;
+
+	// PortalPlane bounds in its own space, invalid without a mesh
+	FBox PlaneLocalBox = FBox(ForceInit);
+	int32 PlaneNormalAxis = 0;
+
+	void OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
 
 	UFUNCTION(BlueprintCallable)
 	void CreateDynamicMaterialInstance();
@@ -106,45 +204,89 @@ private:
 	UFUNCTION(BlueprintCallable)
 	void UpdateSceneCapture();
 
+	/** Clip plane for the captures that cannot use the oblique projection, enabled per capture. */
 	UFUNCTION(BlueprintCallable)
 	void SetClipPlanes();
 
 	UFUNCTION(BlueprintCallable)
 	void PreventCameraClipping();
 
-	UFUNCTION(BlueprintCallable)
+	/** @Deprecated: UPortalSubsystem sizes Portal_RT. Kept until the portal Blueprints are resaved without it. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="Portal_RT is sized by UPortalSubsystem, this does nothing."))
 	void UpdateViewportSize();
-	
+
+	/** Teleports the actors in Detection whose move since the last check went through the portal plane, front to back. */
 	UFUNCTION(BlueprintCallable)
 	void CheckTeleportPlayer();
 
-	UFUNCTION(BlueprintCallable)
-	void HandleCharacterTeleport(class ACharacter* OverlappingCharacter, FName TeleportedTag, FName LinkedTeleportedTag);
+	UFUNCTION()
+	void OnDetectionBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+
+	UFUNCTION()
+	void OnDetectionEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex);
+
+	void AddCrossingCandidate(AActor* Actor);
+
+	/** Whether the segment goes from the front of the portal to its back through the PortalPlane quad. */
+	bool IsSegmentCrossingPortal(const FVector& Start, const FVector& End) const;
 
 	UFUNCTION(BlueprintCallable)
-	void HandleActorTeleport(AActor* OverlappingActor, FName TeleportedTag, FName LinkedTeleportedTag);
+	void HandleCharacterTeleport(class ACharacter* OverlappingCharacter);
 
 	UFUNCTION(BlueprintCallable)
-	void PerformTeleport(AActor* Actor, FName TeleportedTag, FName LinkedTeleportedTag);
-	
+	void HandleActorTeleport(AActor* OverlappingActor);
+
+	/** Keeps Actor out of this portal and LinkedPortal for UPortalSubsystem::TeleportCooldown seconds. */
 	UFUNCTION(BlueprintCallable)
+	void AddTeleportCooldown(AActor* Actor);
+
+	bool IsOnTeleportCooldown(const AActor* Actor);
+
+	// Do tempo das tags de teleporte, ficam até os Blueprints dos portais serem salvos de novo sem elas
+
+	/** @Deprecated: forwards to AddTeleportCooldown, the tags are no longer used. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="Use the teleport cooldown of UPortalSubsystem, the tags are ignored."))
 	void AddTeleportTagsWithTimer(AActor* Actor, FName TeleportedTag, FName LinkedTeleportedTag);
 
-	UFUNCTION(BlueprintCallable)
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="CheckTeleportPlayer checks crossings itself."))
 	bool IsMovingTowardsPortal(const FVector& Velocity);
 
-	UFUNCTION(BlueprintCallable)
+	/** @Deprecated: one LastPosition for every actor, tested with GetSegmentCrossing. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="CheckTeleportPlayer tracks crossings per actor."))
 	bool IsPlayerCrossingPortal(FVector point);
 
-	UFUNCTION(BlueprintCallable)
+	/** @Deprecated: forwards to PerformTeleport with the first local player's character. */
+	UFUNCTION(BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="Use PerformTeleport."))
 	void DoTeleportPlayer();
 
+	/** @Deprecated: removes the old "teleported" tag, nothing adds it any more. */
+	UFUNCTION(meta=(DeprecatedFunction, DeprecationMessage="Teleport cooldowns no longer use tags."))
+	void RemoveTeleportTag(AActor* actorToRemoveTag);
+
+	/** Teleports Character and cuts the camera of the player controlling it. */
+	UFUNCTION(BlueprintCallable)
+	void DoTeleportCharacter(ACharacter* Character);
+
 	UFUNCTION(BlueprintCallable)
 	void CallSmoothRotation(ACharacter* player, FRotator Rotation);
 
 	UFUNCTION(BlueprintCallable)
 	void DoTeleport(AActor* actorToTeleport);
 
+	/** Moves a simulating body through the portal with TeleportPhysics and carries its linear and angular velocity over. */
+	void DoTeleportPhysicsBody(AActor* actorToTeleport, UPrimitiveComponent* Body);
+
+	/** Shows a copy at the linked portal of every simulating body that is halfway through this one. */
+	void UpdateStraddleClones();
+	UStaticMeshComponent* AcquireStraddleClone(int32 Index, UStaticMeshComponent* Source);
+	void HideStraddleClones(int32 FirstIndex);
+
+	// Pooled visual copies, the first NumActiveStraddleClones are in use
+	UPROPERTY(Transient)
+	TArray<UStaticMeshComponent*> StraddleClones;
+	TArray<TWeakObjectPtr<UStaticMeshComponent>> StraddleSources;
+	int32 NumActiveStraddleClones = 0;
+
 	UFUNCTION(BlueprintCallable)
 	FVector UpdateActorVelocity(FVector Velocity);
 	
@@ -160,10 +302,20 @@ private:
 	FVector UpdateSceneCapture_GetUpdatedSceneCaptureLocation(FVector OldLocation);
 	FRotator UpdateSceneCapture_GetUpdatedSceneCaptureRotation(FRotator OldRotation);
 
+	/**
+	 * Captures up to ScheduledRecursion + 1 levels of the view through the portal, starting at
+	 * Location/Rotation or the player camera when Location is zero. Levels are rendered deepest
+	 * first and stop once the portal inside a level gets smaller than MinRecursionPixels. The
+	 * renders made are reported back to UPortalSubsystem.
+	 */
 	UFUNCTION(BlueprintCallable)
 	void UpdateSceneCaptureRecursive(FVector Location, FRotator Rotation);
 
-	UFUNCTION()
-	void RemoveTeleportTag(AActor* actorToRemoveTag);
+	/** Render target of recursion Level (1 or more), Portal_RT halved Level times. */
+	UTextureRenderTarget2D* GetRecursionTarget(class UPortalSubsystem* Portals, int32 Level);
+
+	// Pooled render targets of recursion levels 1 and deeper
+	UPROPERTY(Transient)
+	TArray<UTextureRenderTarget2D*> RecursionTargets;
 	
 };